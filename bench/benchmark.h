@@ -0,0 +1,169 @@
+//
+// Arnés mínimo de microbenchmarks: calentamiento, muchas repeticiones, mediana y percentiles, salida JSON.
+//
+
+#ifndef KITSUNE_CPP_BENCHMARK_H
+#define KITSUNE_CPP_BENCHMARK_H
+
+#include <cstdio>
+#include <cmath>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <initializer_list>
+
+
+// Impide que el compilador elimine un cálculo cuyo resultado no se usa
+template<class T>
+inline void doNotOptimize(const T &value) {
+#if defined(__GNUC__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const T *sink;
+    sink = &value;
+#endif
+}
+
+// Configuración de las mediciones
+struct BenchmarkConfig {
+    double warmupSeconds = 0.05; // Calentamiento antes de calibrar (cachés, predictor de saltos, frecuencia)
+
+    double sampleSeconds = 0.002; // Duración mínima de cada muestra; fija el número de operaciones por muestra
+
+    int repetitions = 31; // Muestras por benchmark
+
+    std::string filter; // Solo los benchmarks cuyo nombre contiene este texto (vacío = todos)
+};
+
+// Resultado de un benchmark, en nanosegundos por operación
+struct BenchmarkResult {
+    std::string name, params;
+
+    long long opsPerSample = 0;
+
+    int repetitions = 0;
+
+    double min = 0, median = 0, p10 = 0, p90 = 0, p99 = 0, mean = 0, stddev = 0;
+};
+
+
+/**
+ *  BenchmarkSuite: mide funciones que ejecutan una operación por llamada.
+ *
+ *  Cada benchmark se calienta durante warmupSeconds, se calibra el número de operaciones por muestra para que cada
+ *  muestra dure al menos sampleSeconds (así la resolución del reloj no cuenta) y se toman repetitions muestras.
+ *  Se informa del tiempo por operación: mínimo, mediana, percentiles 10, 90 y 99, media y desviación típica entre muestras.
+ *  La mediana y los percentiles son robustos frente a interrupciones del sistema, que solo afectan a algunas muestras
+ */
+class BenchmarkSuite {
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    BenchmarkConfig config;
+
+    std::vector<BenchmarkResult> results;
+
+    // Segundos que tarda en ejecutar ops operaciones
+    template<class Op>
+    static double time(Op &op, long long ops) {
+        Clock::time_point t0 = Clock::now();
+        for (long long i = 0; i < ops; ++i)op();
+        return std::chrono::duration<double>(Clock::now() - t0).count();
+    }
+
+    static double percentile(const std::vector<double> &sorted, double q) {
+        double pos = q * (sorted.size() - 1);
+        size_t lo = (size_t) pos;
+        if (lo + 1 >= sorted.size())return sorted.back();
+        return sorted[lo] + (pos - lo) * (sorted[lo + 1] - sorted[lo]);
+    }
+
+public:
+    explicit BenchmarkSuite(const BenchmarkConfig &config = BenchmarkConfig()) : config(config) {}
+
+    // Si el benchmark name pasa el filtro
+    bool enabled(const std::string &name) const {
+        return config.filter.empty() || name.find(config.filter) != std::string::npos;
+    }
+
+    // Si alguno de los benchmarks de un grupo pasa el filtro (para saltarse la preparación común del grupo)
+    bool enabledAny(std::initializer_list<const char *> names) const {
+        for (const char *name : names)
+            if (enabled(name))return true;
+        return false;
+    }
+
+    // Mide op (una operación por llamada, sin argumentos); params describe la variante (tamaños, cardinalidad...).
+    // op es un parámetro de plantilla para que la llamada se pueda integrar en el bucle de medición
+    template<class Op>
+    void run(const std::string &name, const std::string &params, Op op) {
+        if (!enabled(name))return;
+        // Calentamiento y calibración: se dobla el número de operaciones hasta llenar el tiempo de calentamiento
+        long long ops = 1;
+        double spent = 0, last = 0;
+        while (spent < config.warmupSeconds) {
+            last = time(op, ops);
+            spent += last;
+            if (last < config.warmupSeconds / 4)ops *= 2;
+        }
+        double perOp = last / ops;
+        long long perSample = std::max(1LL, (long long) std::ceil(config.sampleSeconds / std::max(perOp, 1e-12)));
+
+        std::vector<double> samples(config.repetitions);
+        for (double &s : samples)s = time(op, perSample) / perSample * 1e9;
+
+        BenchmarkResult r;
+        r.name = name;
+        r.params = params;
+        r.opsPerSample = perSample;
+        r.repetitions = config.repetitions;
+        double sum = 0, sq = 0;
+        for (double s : samples)sum += s;
+        r.mean = sum / samples.size();
+        for (double s : samples)sq += (s - r.mean) * (s - r.mean);
+        r.stddev = samples.size() > 1 ? std::sqrt(sq / (samples.size() - 1)) : 0;
+        std::sort(samples.begin(), samples.end());
+        r.min = samples.front();
+        r.median = percentile(samples, 0.5);
+        r.p10 = percentile(samples, 0.1);
+        r.p90 = percentile(samples, 0.9);
+        r.p99 = percentile(samples, 0.99);
+        results.push_back(r);
+        std::fprintf(stderr, "%-36s %-28s median %12.1f ns  p10 %12.1f  p90 %12.1f\n", name.c_str(), params.c_str(),
+                     r.median, r.p10, r.p90);
+    }
+
+    const std::vector<BenchmarkResult> &getResults() const { return results; }
+
+    // Escribe los resultados en JSON, con el compilador y la fecha para poder comparar compilaciones
+    void writeJSON(FILE *fp) const {
+        char date[32];
+        std::time_t now = std::time(nullptr);
+        std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+        std::fprintf(fp, "{\n  \"context\": {\n    \"date\": \"%s\",\n", date);
+#if defined(__VERSION__)
+        std::fprintf(fp, "    \"compiler\": \"%s\",\n", __VERSION__);
+#endif
+#if defined(NDEBUG)
+        std::fprintf(fp, "    \"assertions\": false,\n");
+#else
+        std::fprintf(fp, "    \"assertions\": true,\n");
+#endif
+        std::fprintf(fp, "    \"warmup_seconds\": %g,\n    \"sample_seconds\": %g,\n    \"repetitions\": %d\n  },\n",
+                     config.warmupSeconds, config.sampleSeconds, config.repetitions);
+        std::fprintf(fp, "  \"benchmarks\": [");
+        for (size_t i = 0; i < results.size(); ++i) {
+            const BenchmarkResult &r = results[i];
+            std::fprintf(fp, "%s\n    {\"name\": \"%s\", \"params\": \"%s\", \"unit\": \"ns/op\", \"ops_per_sample\": %lld, "
+                             "\"repetitions\": %d, \"min\": %.3f, \"median\": %.3f, \"p10\": %.3f, \"p90\": %.3f, "
+                             "\"p99\": %.3f, \"mean\": %.3f, \"stddev\": %.3f}",
+                         i == 0 ? "" : ",", r.name.c_str(), r.params.c_str(), r.opsPerSample, r.repetitions, r.min,
+                         r.median, r.p10, r.p90, r.p99, r.mean, r.stddev);
+        }
+        std::fprintf(fp, "\n  ]\n}\n");
+    }
+};
+
+#endif //KITSUNE_CPP_BENCHMARK_H
@@ -0,0 +1,55 @@
+//
+// Temporizador de bajo coste basado en el contador de ciclos (TSC) para medir etapas por paquete.
+//
+
+#ifndef KITSUNE_CPP_CYCLETIMER_H
+#define KITSUNE_CPP_CYCLETIMER_H
+
+#include <cstdint>
+#include <chrono>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+
+/**
+ *  CycleTimer: lecturas del TSC (unos pocos ns, sin llamada al sistema) en x86 y de steady_clock en el resto.
+ *  Los ciclos se convierten a segundos con la frecuencia medida contra steady_clock en calibrate (en los procesadores
+ *  actuales el TSC es invariante: su frecuencia no depende de la del núcleo ni del estado de energía)
+ */
+class CycleTimer {
+private:
+    double secondsPerTick = 1e-9;
+
+public:
+    static inline uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // Mide la frecuencia del contador durante ms milisegundos
+    void calibrate(int ms = 50) {
+#if defined(__x86_64__) || defined(__i386__)
+        auto t0 = std::chrono::steady_clock::now();
+        uint64_t c0 = now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+        uint64_t c1 = now();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        secondsPerTick = seconds / (double) (c1 - c0);
+#endif
+    }
+
+    double seconds(uint64_t ticks) const { return ticks * secondsPerTick; }
+
+    uint64_t ticks(double seconds) const { return (uint64_t) (seconds / secondsPerTick); }
+
+    double ticksPerSecond() const { return 1 / secondsPerTick; }
+};
+
+#endif //KITSUNE_CPP_CYCLETIMER_H
@@ -0,0 +1,253 @@
+//
+// Microbenchmarks de los núcleos de Kitsune. Uso:
+//   Kitsune_bench [--filter texto] [--repetitions n] [--sample-ms ms] [--warmup-ms ms] [--json fichero]
+// Los resultados en JSON van a --json o, por defecto, a la salida estándar; el progreso va a la salida de errores
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "benchmark.h"
+#include "../include/utils.h"
+#include "../include/netStat.h"
+#include "../include/neuralnet.h"
+#include "../include/cluster.h"
+#include "../include/kitNET.h"
+#include "../include/frozen.h"
+#include "../include/quantize.h"
+
+
+// Generador determinista para que las entradas sean las mismas en todas las compilaciones
+static unsigned long long benchState = 0x2545F4914F6CDD1DULL;
+
+static double nextUniform() {
+    benchState ^= benchState >> 12;
+    benchState ^= benchState << 25;
+    benchState ^= benchState >> 27;
+    return ((benchState * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static std::vector<double> randomVectors(size_t rows, int n) {
+    std::vector<double> X(rows * n);
+    for (double &v : X)v = nextUniform();
+    return X;
+}
+
+static std::string format(const char *fmt, int a, int b = 0) {
+    char text[64];
+    snprintf(text, sizeof(text), fmt, a, b);
+    return text;
+}
+
+
+// TsvReader: una fila de paquete como las de tshark (19 columnas) por operación, desde un fichero temporal
+static void benchTsv(BenchmarkSuite &suite) {
+    if (!suite.enabledAny({"TsvReader::nextLine", "TsvReader::getDouble"}))return;
+    FILE *fp = tmpfile();
+    if (fp == nullptr)return;
+    for (int i = 0; i < 100000; ++i)
+        fprintf(fp, "%.6f\t%d\taa:00:00:00:00:%02x\tbb:00:00:00:00:%02x\t192.168.%d.%d\t10.0.%d.%d\t%d\t443\t\t\t\t\t\t\t\t\t\t\t\n",
+                i * 0.0003, 60 + i % 1400, i % 256, (i / 7) % 256, i % 4, i % 250, (i / 3) % 8, i % 200,
+                1024 + i % 60000);
+    rewind(fp);
+    TsvReader reader(fp); // Cierra fp al destruirse
+    suite.run("TsvReader::nextLine", "19 columns", [&]() {
+        int cols = reader.nextLine();
+        if (cols == 0) {
+            rewind(fp);
+            cols = reader.nextLine();
+        }
+        doNotOptimize(cols);
+    });
+    suite.run("TsvReader::getDouble", "time + size", [&]() {
+        double v = reader.getDouble(0) + reader.getDouble(1);
+        doNotOptimize(v);
+    });
+}
+
+// IncStatDB: actualizaciones de flujos unidimensionales con distinto número de flujos vivos y bidimensionales con
+// distinto número de destinos por origen (cada actualización 2D recorre todas las relaciones del origen)
+static void benchIncStat(BenchmarkSuite &suite) {
+    std::vector<double> lambdas = {5, 3, 1, 0.1, 0.01};
+    double result[32];
+
+    for (int streams : {1, 100, 10000}) {
+        if (!suite.enabled("IncStatDB::updateGet1DStats"))continue;
+        IncStatDB db(&lambdas);
+        std::vector<std::string> ids(streams);
+        for (int i = 0; i < streams; ++i)ids[i] = "192.168." + std::to_string(i / 256) + "." + std::to_string(i % 256);
+        double t = 0;
+        int next = 0;
+        suite.run("IncStatDB::updateGet1DStats", format("%d streams", streams), [&]() {
+            t += 1e-4;
+            int k = db.updateGet1DStats(ids[next], t, 60 + next % 1400, result);
+            if (++next == streams)next = 0;
+            doNotOptimize(k);
+        });
+    }
+
+    const int sources = 100;
+    for (int fanout : {1, 8, 64}) {
+        if (!suite.enabled("IncStatDB::updateGet2DStats"))continue;
+        IncStatDB db(&lambdas);
+        std::vector<std::string> src(sources), dst(fanout);
+        for (int i = 0; i < sources; ++i)src[i] = "10.0.0." + std::to_string(i);
+        for (int j = 0; j < fanout; ++j)dst[j] = "172.16.0." + std::to_string(j);
+        double t = 0;
+        int next = 0;
+        suite.run("IncStatDB::updateGet2DStats", format("%d sources x %d fan-out", sources, fanout), [&]() {
+            t += 1e-4;
+            int k = db.updateGet2DStats(src[next % sources], dst[(next / sources) % fanout], t, 60 + next % 1400,
+                                        result);
+            ++next;
+            doNotOptimize(k);
+        });
+    }
+
+    if (suite.enabled("IncStat::processDecay")) {
+        IncStat stat("bench", &lambdas);
+        double t = 0;
+        suite.run("IncStat::processDecay", format("%d windows", (int) lambdas.size()), [&]() {
+            t += 1e-4;
+            stat.processDecay(t);
+            doNotOptimize(stat.cur_mean);
+        });
+    }
+}
+
+// Dense y AE con tamaños de los autocodificadores de la capa integrada (pequeños) y de redes mayores
+static void benchDense(BenchmarkSuite &suite) {
+    const int sizes[][2] = {{8, 6}, {32, 24}, {128, 96}, {512, 384}};
+    for (const int *s : sizes) {
+        int in = s[0], out = s[1];
+        if (!suite.enabledAny({"Dense::feedForward", "Dense::feedForward+BackPropagation"}))continue;
+        Dense<KitNETActivation> layer(in, out, 0.1);
+        std::vector<double> x = randomVectors(1, in), y(out), g0 = randomVectors(1, std::max(in, out));
+        std::vector<double> g(g0.size());
+        for (double &v : g0)v = (v - 0.5) * 1e-3;
+        suite.run("Dense::feedForward", format("%dx%d", in, out), [&]() {
+            layer.feedForward(x.data(), y.data());
+            doNotOptimize(y[0]);
+        });
+        // BackPropagation necesita las activaciones guardadas por la propagación hacia delante: se miden juntas
+        suite.run("Dense::feedForward+BackPropagation", format("%dx%d", in, out), [&]() {
+            layer.feedForward(x.data(), y.data(), true);
+            std::copy(g0.begin(), g0.begin() + out, g.begin());
+            layer.BackPropagation(g.data());
+            doNotOptimize(g[0]);
+        });
+    }
+
+    for (int v : {5, 10, 50, 100}) {
+        if (!suite.enabled("AE::train"))continue;
+        int h = (int) std::ceil(v * 0.75);
+        AE<KitNETActivation> ae(v, h, 0.1);
+        std::vector<double> X = randomVectors(256, v);
+        int next = 0;
+        suite.run("AE::train", format("%dx%d", v, h), [&]() {
+            double e = ae.train(X.data() + (size_t) next * v);
+            next = (next + 1) & 255;
+            doNotOptimize(e);
+        });
+    }
+}
+
+// KitNET entrenado con vectores aleatorios del tamaño de NetStat (100); ejecución normal, constante, congelada y
+// cuantizada (execute_batch mide un lote de 64 vectores por iteración)
+static void benchKitNET(BenchmarkSuite &suite) {
+    if (!suite.enabledAny({"KitNET::execute", "KitNET::execute(context)", "FrozenKitNET::execute",
+                           "QuantizedKitNET::execute", "QuantizedKitNET::execute_batch"}))
+        return;
+    const int n = 100, rows = 1024;
+    rand_uniform(0, 1);
+    srand(1);
+    KitNET model(n, 10, 1000);
+    std::vector<double> T = randomVectors(6000, n), X = randomVectors(rows, n);
+    for (int i = 0; i < 6000; ++i)model.train(T.data() + (size_t) i * n);
+    std::string params = format("n=%d, %d autoencoders", n, (int) model.getFeatureMap()->size());
+
+    int next = 0;
+    suite.run("KitNET::execute", params, [&]() {
+        double e = model.execute(X.data() + (size_t) next * n);
+        next = (next + 1) & (rows - 1);
+        doNotOptimize(e);
+    });
+    KitNETContext context(model);
+    suite.run("KitNET::execute(context)", params, [&]() {
+        double e = model.execute(X.data() + (size_t) next * n, context);
+        next = (next + 1) & (rows - 1);
+        doNotOptimize(e);
+    });
+    FrozenKitNET *frozen = model.freeze();
+    suite.run("FrozenKitNET::execute", params, [&]() {
+        double e = frozen->execute(X.data() + (size_t) next * n);
+        next = (next + 1) & (rows - 1);
+        doNotOptimize(e);
+    });
+    delete frozen;
+    QuantizedKitNET quantized(model, T.data(), 1000);
+    suite.run("QuantizedKitNET::execute", params, [&]() {
+        double e = quantized.execute(X.data() + (size_t) next * n);
+        next = (next + 1) & (rows - 1);
+        doNotOptimize(e);
+    });
+    std::vector<double> scores(64);
+    suite.run("QuantizedKitNET::execute_batch", params + ", 64 vectors", [&]() {
+        quantized.execute_batch(X.data() + (size_t) next * n, 64, scores.data());
+        next = (next + 64) & (rows - 1);
+        doNotOptimize(scores[0]);
+    });
+}
+
+// Cluster: actualización de los momentos con cada vector y construcción del mapa de características
+static void benchCluster(BenchmarkSuite &suite) {
+    for (int n : {20, 100}) {
+        if (!suite.enabledAny({"Cluster::update", "Cluster::getFeatureMap"}))continue;
+        Cluster cluster(n);
+        std::vector<double> X = randomVectors(1024, n);
+        int next = 0;
+        suite.run("Cluster::update", format("n=%d", n), [&]() {
+            cluster.update(X.data() + (size_t) next * n);
+            next = (next + 1) & 1023;
+        });
+        suite.run("Cluster::getFeatureMap", format("n=%d, max 10", n), [&]() {
+            std::vector<std::vector<int> > *map = cluster.getFeatureMap(10);
+            doNotOptimize(map->size());
+            delete map;
+        });
+    }
+}
+
+int main(int argc, char **argv) {
+    BenchmarkConfig config;
+    const char *json = nullptr;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--filter") == 0)config.filter = argv[i + 1];
+        else if (strcmp(argv[i], "--repetitions") == 0)config.repetitions = std::max(1, atoi(argv[i + 1]));
+        else if (strcmp(argv[i], "--sample-ms") == 0)config.sampleSeconds = atof(argv[i + 1]) / 1000;
+        else if (strcmp(argv[i], "--warmup-ms") == 0)config.warmupSeconds = atof(argv[i + 1]) / 1000;
+        else if (strcmp(argv[i], "--json") == 0)json = argv[i + 1];
+        else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    BenchmarkSuite suite(config);
+    benchTsv(suite);
+    benchIncStat(suite);
+    benchDense(suite);
+    benchKitNET(suite);
+    benchCluster(suite);
+
+    FILE *fp = json != nullptr ? fopen(json, "w") : stdout;
+    if (fp == nullptr) {
+        fprintf(stderr, "cannot write %s\n", json);
+        return 1;
+    }
+    suite.writeJSON(fp);
+    if (fp != stdout)fclose(fp);
+    return 0;
+}
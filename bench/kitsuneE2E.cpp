@@ -0,0 +1,308 @@
+//
+// Benchmark de extremo a extremo: procesa una captura o un fichero de vectores completo como Kitsune y mide el tiempo
+// de cada etapa por paquete con el TSC. Uso:
+//   Kitsune_e2e fichero [--type pcap|tsv|csv|ftsv|fcsv] [--fm n] [--ad n] [--max-ae n] [--limit paquetes]
+//               [--pace factor | --rate paquetes/s] [--out puntuaciones] [--json fichero] [--seed n]
+// Sin --pace ni --rate los paquetes se procesan tan rápido como se pueda (rendimiento). Con --pace los paquetes llegan
+// en sus tiempos originales divididos por factor (1 = tiempo real, 10 = diez veces más rápido) y con --rate a ritmo
+// constante; en los dos casos se informa además de la latencia de cada paquete desde su llegada hasta su puntuación
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include "cycleTimer.h"
+#include "../include/utils.h"
+#include "../include/featureExtractor.h"
+#include "../include/kitNET.h"
+
+
+// Etapas por paquete; FM/Cluster es el entrenamiento mientras se aprende el mapa de características
+enum Stage {
+    StageParse, StageNetStat, StageCluster, StageTrain, StageExecute, StageOutput, StageCount
+};
+
+static const char *stageNames[StageCount] = {"parse", "NetStat", "FM/Cluster", "AE train", "AE execute", "output"};
+
+struct StageTotals {
+    uint64_t ticks[StageCount] = {};
+
+    long long packets[StageCount] = {};
+};
+
+struct E2EConfig {
+    const char *file = nullptr;
+
+    FileType type = PacketTSV;
+
+    int fmTrain = 5000, adTrain = 50000, maxAE = 10;
+
+    long long limit = 0; // Paquetes como máximo, 0 = todo el fichero
+
+    double pace = 0; // Factor de aceleración sobre los tiempos de la captura, 0 = sin ritmo
+
+    double rate = 0; // Paquetes por segundo a ritmo constante, 0 = sin ritmo
+
+    const char *out = nullptr, *json = nullptr;
+
+    unsigned seed = 1;
+};
+
+// Texto como cadena JSON (sin comillas): escapa las comillas, las barras invertidas (rutas de Windows) y los controles
+static std::string jsonEscape(const char *text) {
+    std::string escaped;
+    for (const char *c = text; *c != '\0'; ++c) {
+        if (*c == '"' || *c == '\\')escaped += '\\';
+        if ((unsigned char) *c < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", (unsigned char) *c);
+            escaped += code;
+        } else escaped += *c;
+    }
+    return escaped;
+}
+
+static bool parseType(const char *text, FileType &type) {
+    if (strcmp(text, "pcap") == 0)type = PCAP;
+    else if (strcmp(text, "tsv") == 0)type = PacketTSV;
+    else if (strcmp(text, "csv") == 0)type = PacketCSV;
+    else if (strcmp(text, "ftsv") == 0)type = FeatureTSV;
+    else if (strcmp(text, "fcsv") == 0)type = FeatureCSV;
+    else return false;
+    return true;
+}
+
+// Tipo por la extensión del fichero; los ficheros de vectores hay que indicarlos con --type
+static FileType guessType(const char *file) {
+    const char *dot = strrchr(file, '.');
+    if (dot != nullptr && (strcmp(dot, ".pcap") == 0 || strcmp(dot, ".pcapng") == 0))return PCAP;
+    if (dot != nullptr && strcmp(dot, ".csv") == 0)return PacketCSV;
+    return PacketTSV;
+}
+
+static double percentile(const std::vector<double> &sorted, double q) {
+    if (sorted.empty())return 0;
+    double pos = q * (sorted.size() - 1);
+    size_t lo = (size_t) pos;
+    if (lo + 1 >= sorted.size())return sorted.back();
+    return sorted[lo] + (pos - lo) * (sorted[lo + 1] - sorted[lo]);
+}
+
+// Espera hasta el instante target del TSC: duerme mientras quede más de un margen y el resto lo espera activamente
+static void waitUntil(const CycleTimer &timer, uint64_t target) {
+    const uint64_t margin = timer.ticks(200e-6);
+    for (;;) {
+        uint64_t now = CycleTimer::now();
+        if (now >= target)return;
+        if (target - now > margin)
+            std::this_thread::sleep_for(std::chrono::duration<double>(timer.seconds(target - now - margin)));
+    }
+}
+
+int main(int argc, char **argv) {
+    E2EConfig config;
+    bool typeGiven = false;
+    for (int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if (argv[i][0] != '-' && config.file == nullptr)config.file = argv[i];
+        else if (strcmp(argv[i], "--type") == 0 && hasValue) {
+            if (!parseType(argv[++i], config.type)) {
+                fprintf(stderr, "unknown file type %s\n", argv[i]);
+                return 1;
+            }
+            typeGiven = true;
+        } else if (strcmp(argv[i], "--fm") == 0 && hasValue)config.fmTrain = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--ad") == 0 && hasValue)config.adTrain = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--max-ae") == 0 && hasValue)config.maxAE = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--limit") == 0 && hasValue)config.limit = atoll(argv[++i]);
+        else if (strcmp(argv[i], "--pace") == 0 && hasValue)config.pace = atof(argv[++i]);
+        else if (strcmp(argv[i], "--rate") == 0 && hasValue)config.rate = atof(argv[++i]);
+        else if (strcmp(argv[i], "--out") == 0 && hasValue)config.out = argv[++i];
+        else if (strcmp(argv[i], "--json") == 0 && hasValue)config.json = argv[++i];
+        else if (strcmp(argv[i], "--seed") == 0 && hasValue)config.seed = (unsigned) atoi(argv[++i]);
+        else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (config.file == nullptr || config.fmTrain <= 0 || config.adTrain < 0 || config.maxAE <= 0) {
+        fprintf(stderr, "usage: %s file [--type pcap|tsv|csv|ftsv|fcsv] [--fm n] [--ad n] [--max-ae n] [--limit n] "
+                        "[--pace factor | --rate pps] [--out file] [--json file] [--seed n]\n", argv[0]);
+        return 1;
+    }
+    if (!typeGiven)config.type = guessType(config.file);
+    bool hasPackets = config.type == PCAP || config.type == PacketTSV || config.type == PacketCSV;
+    if (config.pace > 0 && !hasPackets) {
+        fprintf(stderr, "--pace needs packet timestamps, use --rate with feature files\n");
+        return 1;
+    }
+    bool paced = config.pace > 0 || config.rate > 0;
+    if (config.pace > 0 && config.rate > 0) {
+        fprintf(stderr, "--pace and --rate are exclusive\n");
+        return 1;
+    }
+
+    CycleTimer timer;
+    timer.calibrate();
+
+    // La conversión de pcap con tshark ocurre en el constructor y se informa aparte
+    uint64_t c0 = CycleTimer::now();
+    FE fe(config.file, config.type);
+    double setupSeconds = timer.seconds(CycleTimer::now() - c0);
+    int n = fe.getVectorSize();
+
+    rand_uniform(0, 1); // Primera llamada, siembra con la hora; después se fija la semilla para repetir la inicialización
+    srand(config.seed);
+    KitNET model(n, config.maxAE, config.fmTrain);
+    long long trainNum = (long long) config.fmTrain + config.adTrain;
+
+    FILE *out = nullptr;
+    if (config.out != nullptr && (out = fopen(config.out, "w")) == nullptr) {
+        fprintf(stderr, "cannot write %s\n", config.out);
+        return 1;
+    }
+
+    StageTotals totals;
+    std::vector<double> latencies; // Segundos desde la llegada hasta la puntuación, solo paquetes ejecutados
+    double *x = new double[n];
+    PacketInfo info;
+    double checksum = 0, firstTime = 0, lastTime = 0, lateMax = 0;
+    long long packets = 0, late = 0;
+    uint64_t start = 0;
+
+    uint64_t begin = CycleTimer::now();
+    for (;;) {
+        if (config.limit > 0 && packets == config.limit)break;
+        uint64_t t0 = CycleTimer::now();
+        if (!fe.readPacket(info))break;
+        uint64_t t1 = CycleTimer::now();
+        totals.ticks[StageParse] += t1 - t0;
+        ++totals.packets[StageParse];
+        if (packets == 0) {
+            firstTime = info.time;
+            start = t1;
+        }
+        lastTime = info.time;
+
+        // Llegada programada del paquete. La fila se lee por adelantado, así que la latencia empieza después de
+        // decodificarla; si el procesamiento va por detrás incluye la espera en cola (sin omisión coordinada)
+        uint64_t arrival = t1;
+        if (paced) {
+            double offset = config.pace > 0 ? (info.time - firstTime) / config.pace : packets / config.rate;
+            arrival = start + timer.ticks(std::max(offset, 0.0));
+            if (arrival > t1)waitUntil(timer, arrival);
+            else if (t1 - arrival > timer.ticks(1e-3)) {
+                ++late;
+                lateMax = std::max(lateMax, timer.seconds(t1 - arrival));
+            }
+            t1 = CycleTimer::now();
+        }
+
+        fe.computeVector(info, x);
+        uint64_t t2 = CycleTimer::now();
+        if (hasPackets) {
+            totals.ticks[StageNetStat] += t2 - t1;
+            ++totals.packets[StageNetStat];
+        } else totals.ticks[StageParse] += t2 - t1; // Ficheros de vectores: copiar el vector leído es parte de leerlo
+
+        double score = 0;
+        Stage stage;
+        if (packets < trainNum) {
+            stage = model.isInitialized() ? StageTrain : StageCluster;
+            score = model.train(x);
+        } else {
+            stage = StageExecute;
+            score = model.execute(x);
+        }
+        uint64_t t3 = CycleTimer::now();
+        totals.ticks[stage] += t3 - t2;
+        ++totals.packets[stage];
+
+        if (out != nullptr)fprintf(out, "%.17g\n", score);
+        else checksum += score;
+        uint64_t t4 = CycleTimer::now();
+        totals.ticks[StageOutput] += t4 - t3;
+        ++totals.packets[StageOutput];
+
+        if (paced && stage == StageExecute)latencies.push_back(timer.seconds(t4 - arrival));
+        ++packets;
+    }
+    double elapsed = timer.seconds(CycleTimer::now() - begin);
+    delete[] x;
+    if (out != nullptr)fclose(out);
+
+    // Tiempo de proceso: la suma de las etapas, sin las esperas del ritmo
+    uint64_t busyTicks = 0;
+    for (int s = 0; s < StageCount; ++s)busyTicks += totals.ticks[s];
+    double busy = timer.seconds(busyTicks);
+    std::sort(latencies.begin(), latencies.end());
+    double mean = 0;
+    for (double l : latencies)mean += l;
+    if (!latencies.empty())mean /= latencies.size();
+
+    fprintf(stderr, "%s: %lld packets, vector size %d, %d autoencoders, setup %.3f s\n", config.file, packets, n,
+            model.isInitialized() ? (int) model.getFeatureMap()->size() : 0, setupSeconds);
+    fprintf(stderr, "wall %.3f s, busy %.3f s, %.0f packets/s (busy)\n", elapsed, busy,
+            busy > 0 ? packets / busy : 0);
+    fprintf(stderr, "%-12s %10s %12s %12s %7s\n", "stage", "packets", "seconds", "ns/packet", "share");
+    for (int s = 0; s < StageCount; ++s) {
+        if (totals.packets[s] == 0)continue;
+        double seconds = timer.seconds(totals.ticks[s]);
+        fprintf(stderr, "%-12s %10lld %12.4f %12.1f %6.1f%%\n", stageNames[s], totals.packets[s], seconds,
+                seconds / totals.packets[s] * 1e9, busy > 0 ? seconds / busy * 100 : 0);
+    }
+    if (paced) {
+        double offered = config.pace > 0 ? (lastTime > firstTime ? (packets - 1) / (lastTime - firstTime) * config.pace : 0)
+                                         : config.rate;
+        fprintf(stderr, "offered %.0f packets/s, %lld packets arrived more than 1 ms late (max %.3f ms)\n", offered,
+                late, lateMax * 1e3);
+        fprintf(stderr, "latency (%zu executed packets): mean %.1f us, p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n",
+                latencies.size(), mean * 1e6, percentile(latencies, 0.5) * 1e6, percentile(latencies, 0.9) * 1e6,
+                percentile(latencies, 0.99) * 1e6, percentile(latencies, 0.999) * 1e6,
+                latencies.empty() ? 0 : latencies.back() * 1e6);
+    }
+
+    FILE *fp = config.json != nullptr ? fopen(config.json, "w") : stdout;
+    if (fp == nullptr) {
+        fprintf(stderr, "cannot write %s\n", config.json);
+        return 1;
+    }
+    char date[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+    fprintf(fp, "{\n  \"context\": {\n    \"date\": \"%s\",\n", date);
+#if defined(__VERSION__)
+    fprintf(fp, "    \"compiler\": \"%s\",\n", __VERSION__);
+#endif
+    fprintf(fp, "    \"file\": \"%s\",\n    \"fm_train\": %d,\n    \"ad_train\": %d,\n    \"max_ae\": %d,\n"
+                "    \"pace\": %g,\n    \"rate\": %g,\n    \"tsc_hz\": %.0f\n  },\n", jsonEscape(config.file).c_str(),
+            config.fmTrain, config.adTrain, config.maxAE, config.pace, config.rate, timer.ticksPerSecond());
+    fprintf(fp, "  \"packets\": %lld,\n  \"vector_size\": %d,\n  \"setup_seconds\": %.6f,\n  \"wall_seconds\": %.6f,\n"
+                "  \"busy_seconds\": %.6f,\n  \"packets_per_second\": %.1f,\n  \"checksum\": %.17g,\n  \"stages\": [",
+            packets, n, setupSeconds, elapsed, busy, busy > 0 ? packets / busy : 0, checksum);
+    bool first = true;
+    for (int s = 0; s < StageCount; ++s) {
+        if (totals.packets[s] == 0)continue;
+        double seconds = timer.seconds(totals.ticks[s]);
+        fprintf(fp, "%s\n    {\"name\": \"%s\", \"packets\": %lld, \"seconds\": %.6f, \"ns_per_packet\": %.1f}",
+                first ? "" : ",", stageNames[s], totals.packets[s], seconds, seconds / totals.packets[s] * 1e9);
+        first = false;
+    }
+    fprintf(fp, "\n  ]");
+    if (paced)
+        fprintf(fp, ",\n  \"latency_us\": {\"packets\": %zu, \"late_packets\": %lld, \"mean\": %.3f, \"p50\": %.3f, "
+                    "\"p90\": %.3f, \"p99\": %.3f, \"p999\": %.3f, \"max\": %.3f}", latencies.size(), late, mean * 1e6,
+                percentile(latencies, 0.5) * 1e6, percentile(latencies, 0.9) * 1e6,
+                percentile(latencies, 0.99) * 1e6, percentile(latencies, 0.999) * 1e6,
+                latencies.empty() ? 0 : latencies.back() * 1e6);
+    fprintf(fp, "\n}\n");
+    if (fp != stdout)fclose(fp);
+    return 0;
+}
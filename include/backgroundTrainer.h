@@ -0,0 +1,99 @@
+//
+// Entrenamiento continuo en segundo plano con publicación de instantáneas congeladas.
+//
+
+#ifndef KITSUNE_CPP_BACKGROUNDTRAINER_H
+#define KITSUNE_CPP_BACKGROUNDTRAINER_H
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include "kitNET.h"
+#include "frozen.h"
+#include "spscRing.h"
+
+
+/**
+ *  BackgroundTrainer: un hilo entrenador sigue entrenando un modelo sombra mientras el camino caliente puntúa.
+ *
+ *  El camino caliente copia cada vector de características en una cola SPSC con submit (si la cola está llena la muestra
+ *  se descarta y se cuenta, nunca se espera) y puntúa con execute usando la última instantánea publicada.
+ *  El hilo entrenador consume la cola, llama a KitNET::train sobre el modelo sombra y cada publishInterval muestras
+ *  entrenadas congela el modelo (FrozenKitNET) y lo publica con un intercambio atómico del puntero (estilo RCU).
+ *  El camino caliente solo lee un contador de versión por paquete y recoge la nueva instantánea cuando cambia;
+ *  la anterior se libera cuando deja de usarla. La latencia de detección no depende del coste de la retropropagación.
+ *
+ *  submit y execute deben llamarse desde un mismo hilo (las variables temporales de una instantánea no se comparten),
+ *  el resto de consultas se pueden hacer desde cualquiera
+ */
+class BackgroundTrainer {
+private:
+    KitNET *shadow; // Modelo sombra, solo lo usa el hilo entrenador
+
+    int inputSize;
+
+    long long publishInterval; // Muestras entrenadas entre dos publicaciones
+
+    SPSCRing<std::vector<double> > queue; // Copia del flujo de características
+
+    std::shared_ptr<FrozenKitNET> published; // Última instantánea, se accede con std::atomic_load / std::atomic_store
+
+    std::atomic<unsigned> version; // Se incrementa con cada publicación
+
+    // Instantánea en uso por el camino caliente
+    std::shared_ptr<FrozenKitNET> current;
+
+    unsigned currentVersion = 0;
+
+    std::atomic<long long> trained, dropped;
+
+    std::atomic<bool> stop;
+
+    std::thread worker;
+
+    // Bucle del hilo entrenador
+    void trainLoop();
+
+    // Congela el modelo sombra y publica la instantánea
+    void publish();
+
+public:
+    // Constructor, los parámetros son:
+    // 1. El modelo sombra (pasa a ser propiedad del entrenador). Puede estar todavía en la fase de mapeo de características;
+    //    si ya está inicializado se publica una primera instantánea inmediatamente
+    // 2. El número de muestras entrenadas entre dos publicaciones 3. La capacidad de la cola
+    BackgroundTrainer(KitNET *model, long long publish_interval, size_t queue_capacity = 4096);
+
+    // Detiene el hilo entrenador (las muestras pendientes en la cola se descartan) y libera el modelo sombra
+    ~BackgroundTrainer();
+
+    BackgroundTrainer(const BackgroundTrainer &) = delete;
+
+    BackgroundTrainer &operator=(const BackgroundTrainer &) = delete;
+
+    // Copia x en la cola de entrenamiento, devuelve falso si la cola está llena y la muestra se ha descartado
+    bool submit(const double *x);
+
+    // Error de reconstrucción de x con la última instantánea publicada (0 si todavía no hay ninguna)
+    double execute(const double *x);
+
+    // Última instantánea publicada (vacía si todavía no hay ninguna)
+    std::shared_ptr<FrozenKitNET> snapshot() const { return std::atomic_load(&published); }
+
+    // Si ya hay una instantánea con la que puntuar
+    bool ready() const { return version.load(std::memory_order_acquire) != 0; }
+
+    // Espera a que el hilo entrenador haya consumido todas las muestras encoladas hasta ahora
+    void drain();
+
+    // Número de publicaciones
+    unsigned getVersion() const { return version.load(std::memory_order_acquire); }
+
+    // Muestras entrenadas y descartadas por tener la cola llena
+    long long getTrained() const { return trained.load(std::memory_order_relaxed); }
+
+    long long getDropped() const { return dropped.load(std::memory_order_relaxed); }
+};
+
+#endif //KITSUNE_CPP_BACKGROUNDTRAINER_H
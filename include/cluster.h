@@ -9,10 +9,17 @@
 #include <cmath>
 #include <cstdio>
 #include <algorithm>
+#include "utils.h"
+#include "workerPool.h"
 
 /**
  *  一
 Una clase auxiliar, responsable de mantener la información de asociación entre características y realizar agrupaciones jerárquicas.
+ *
+ *  Las estadísticas son un resumen de momentos combinable (Welford / Chan): número de muestras, media y co-momentos
+ *  C_ij = suma((x_i - media_i) * (x_j - media_j)), exactos en cada momento. Dos resúmenes del mismo tamaño de vector,
+ *  construidos con muestras distintas (hilos, ficheros, sensores), se combinan con merge como si se hubieran visto
+ *  todas las muestras, y se pueden guardar y cargar para combinarlos en otro proceso
  */
 class Cluster {
 private:
@@ -20,23 +27,49 @@ private:
     int n;
 
     // El número de instancias procesadas
-    int num;
+    long long num;
 
-    // Matriz de covarianza
-    double **C = nullptr;
+    // Media de cada característica
+    double *mean = nullptr;
 
-    // Suma lineal de cada valor
-    double *sum = nullptr;
-
-    // Suma lineal de cada valor menos la media
-    double *sum1 = nullptr;
-
-    // Cada valor menos la suma de cuadrados de la media
-    double *sum2 = nullptr;
+    // Co-momentos, simétricos: solo el triángulo superior empaquetado por filas (la fila i guarda j = i .. n - 1).
+    // La diagonal es la suma de cuadrados de las desviaciones de cada característica
+    double *C = nullptr;
 
     // Variables temporales durante el cálculo
     double *tmp = nullptr;
 
+    // Desviaciones de un bloque de muestras para la actualización de rango k: respecto a la media anterior (before)
+    // y a la media actualizada (after), BatchRows x n cada una
+    double *before = nullptr, *after = nullptr;
+
+    // Muestras por bloque de update_batch
+    static const int BatchRows = 32;
+
+    // Muestras por hilo a partir de las que update_batch reparte el bloque entre los hilos del grupo
+    static const int ParallelRows = 1024;
+
+    // Inicio de la fila i en el triángulo empaquetado
+    size_t rowOffset(int i) const { return (size_t) i * n - (size_t) i * (i - 1) / 2; }
+
+    // Paso de Welford de la media con x: guarda las desviaciones respecto a la media anterior y a la nueva
+    void accumulate(const double *x, double *dBefore, double *dAfter);
+
+    // Actualización de rango k del triángulo: C += suma de dBefore[r]^T * dAfter[r] (k x n cada una)
+    void rankUpdate(const double *dBefore, const double *dAfter, int k);
+
+    // Agrega rows vectores contiguos en este hilo
+    void updateBlock(const double *X, int rows);
+
+    // Distancia de correlación entre las características a > b; norm es la raíz de la diagonal (0 si no hay varianza)
+    double distance(int a, int b, const double *norm) const {
+        double l = norm[a] * norm[b];
+        if (l <= 0)l = 1e-20;
+        l = 1 - C[rowOffset(b) + a - b] / l;
+        if (l < 0)l = 0;
+        return l;
+    }
+
 public:
     // Constructor
     Cluster(int size);
@@ -44,66 +77,44 @@ public:
     // Incinerador de basuras
     ~Cluster();
 
-    // Agregar una actualización de vector
-    void update(const double *x);
+    Cluster(const Cluster &) = delete;
 
-    // Generar información cartográfica
-    std::vector<std::vector<int> > *getFeatureMap(int maxSize);
-};
+    Cluster &operator=(const Cluster &) = delete;
 
+    // Agregar una actualización de vector
+    void update(const double *x);
 
+    // Agrega rows vectores contiguos (X: rows x n). Cada fila del triángulo se actualiza con un bloque de muestras mientras
+    // está en caché. Con pool y lotes grandes cada hilo resume un tramo contiguo y los resúmenes se combinan en orden
+    void update_batch(const double *X, int rows, WorkerPool *pool = nullptr);
 
-/**
- *  
-Se necesita una estructura auxiliar para la agrupación jerárquica
- */
+    // Combina las estadísticas de other (mismo tamaño de vector) con las propias (Chan et al.)
+    void merge(const Cluster &other);
 
-// Representación escasa de la matriz de distancias, directamente usando triples
-struct DisNode {
-    int id1, id2;
-    double distance;
+    // Guarda el resumen en un fichero binario versionado y little-endian
+    void save(const char *filename) const;
 
-    DisNode(int _i1, int _i2, double _d) : id1(_i1), id2(_i2), distance(_d) {}
-
-    // Sobrecarga menos que signo
-    bool operator<(const DisNode &other) const {
-        return distance < other.distance;
-    }
-};
+    // Carga un resumen guardado con save; el llamador libera el resultado
+    static Cluster *load(const char *filename);
 
+    // Tamaño del vector de instancia y número de muestras resumidas
+    int size() const { return n; }
 
-// Clase de nodo de dendrograma de agrupamiento jerárquico, es un árbol binario
-struct ClusterNode {
-    int id; // Número de nodo
-    int size; //Tamaño del subárbol
+    long long count() const { return num; }
 
-    // Nodo padre
-    ClusterNode *fa = nullptr;
-    // Subárbol izquierdo y derecho
-    ClusterNode *lson = nullptr;
-    ClusterNode *rson = nullptr;
+    // Media de la característica i
+    double getMean(int i) const { return mean[i]; }
 
-    // Constructor
-    ClusterNode(int _id, int _size) : id(_id), size(_size) {}
-
-    // Incinerador de basuras
-    ~ClusterNode() {
-        if (lson != nullptr)delete lson;
-        if (rson != nullptr)delete rson;
+    // Co-momento acumulado de las características i y j (la covarianza muestral es covariance / (count() - 1))
+    double covariance(int i, int j) const {
+        if (i > j)std::swap(i, j);
+        return C[rowOffset(i) + j - i];
     }
 
-    // Obtener el nodo raíz del nodo actual
-    ClusterNode *getRoot() {
-        ClusterNode *now = this;
-        while (now->fa != nullptr)now = now->fa;
-        return now;
-    }
+    // Generar información cartográfica. Con pool el árbol de expansión mínima se calcula en paralelo
+    std::vector<std::vector<int> > *getFeatureMap(int maxSize, WorkerPool *pool = nullptr);
+};
 
-    // Divida el dendrograma a través del tamaño máximo especificado (y guárdelo en el resultado.
-    void getSon(std::vector<std::vector<int>> *result, int max_size);
 
-    // Guarde todos los nodos hoja del subárbol en el resultado.
-    void pushLeaf(std::vector<int> &result);
-};
 
 #endif //KITSUNE_CPP_CLUSTER_H
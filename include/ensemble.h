@@ -0,0 +1,148 @@
+//
+// Capa integrada de KitNET empaquetada en bloques contiguos.
+//
+
+#ifndef KITSUNE_CPP_ENSEMBLE_H
+#define KITSUNE_CPP_ENSEMBLE_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "neuralnet.h"
+#include "aeKernels.h"
+
+/**
+ *  Capa integrada de KitNET: todos los pequeños autocodificadores en una estructura de arreglos.
+ *
+ *  Los pesos de todos los codificadores son contiguos, igual que los de todos los decodificadores, y los umbrales y los
+ *  valores de normalización se indexan por la posición de cada característica en el mapa aplanado (estilo CSR).
+ *  La ejecución es un único barrido fusionado: reunir y normalizar todas las entradas, codificar todos los
+ *  autocodificadores (GEMV diagonal por bloques), activar, decodificar, activar y calcular el RMSE de cada uno.
+ *  Cada GEMV usa el núcleo especializado para su tamaño (aeKernels.h), elegido al construir la capa.
+ *  El entrenamiento usa un AE por autocodificador construido sobre esta misma memoria.
+ *  Todas las operaciones aceptan un rango [begin, end) de autocodificadores; rangos disjuntos no comparten memoria
+ *  y se pueden ejecutar en hilos distintos.
+ */
+class PackedEnsemble {
+private:
+    int ae_num; // Número de autocodificadores
+
+    int total_v; // Suma de las capas visibles (número de características mapeadas)
+
+    int total_h; // Suma de las capas ocultas
+
+    std::vector<int> featureIndex; // Índice de la característica de entrada de cada posición visible (mapa aplanado)
+
+    std::vector<int> vOffset, hOffset; // Inicio de cada autocodificador en las capas visibles y ocultas (ae_num + 1 elementos)
+
+    std::vector<int> wOffset; // Inicio de los pesos de cada autocodificador en encW y decW
+
+    // Bloque único con todos los parámetros: encW | decW | encB | decB | min_v | max_v
+    double *params = nullptr;
+
+    double *encW, *decW, *encB, *decB, *min_v, *max_v; // Secciones del bloque de parámetros
+
+    double *sx = nullptr, *sy = nullptr, *sz = nullptr; // Variables temporales: entrada normalizada, capa oculta y reconstrucción
+
+    AE<KitNETActivation> **layers = nullptr; // Autocodificadores sobre la memoria empaquetada, usados en el entrenamiento
+
+    // Núcleos especializados por tamaño del codificador y del decodificador de cada autocodificador (nullptr = denseForward)
+    std::vector<DenseKernel> encKernels, decKernels;
+
+    bool ownsParams = true; // Si el bloque de parámetros pertenece a este objeto (falso cuando está en memoria externa)
+
+    // Aplana el mapa de características y calcula los desplazamientos de cada autocodificador
+    void layout(const std::vector<std::vector<int> > &featureMap, double vh_rate);
+
+    // Divide el bloque de parámetros en secciones y construye los autocodificadores sobre él
+    void attach(double learning_rate);
+
+    // Codifica, decodifica y calcula el RMSE de los autocodificadores [begin, end) a partir de las entradas ya
+    // normalizadas en sx, con sy y sz como capas oculta y de reconstrucción
+    void forward(const double *sx, double *sy, double *sz, double *out, int begin, int end) const;
+
+public:
+    // Constructor, los parámetros son el mapa de características, la proporción capa oculta / visible y la tasa de aprendizaje
+    PackedEnsemble(const std::vector<std::vector<int> > &featureMap, double vh_rate, double learning_rate);
+
+    // Constructor sobre memoria externa (p. ej. un modelo proyectado con mmap): storage debe contener paramCount() valores
+    // con la disposición del bloque de parámetros; no se inicializa ni se libera
+    PackedEnsemble(const std::vector<std::vector<int> > &featureMap, double vh_rate, double learning_rate,
+                   double *storage);
+
+    ~PackedEnsemble();
+
+    // Número de autocodificadores
+    int size() const { return ae_num; }
+
+    // Tamaños de las capas visible y oculta del autocodificador k
+    int visibleSize(int k) const { return vOffset[k + 1] - vOffset[k]; }
+
+    int hiddenSize(int k) const { return hOffset[k + 1] - hOffset[k]; }
+
+    // Inicio del autocodificador k en las capas visibles y ocultas aplanadas y en los bloques de pesos (k = size() da el total)
+    int visibleOffset(int k) const { return vOffset[k]; }
+
+    int hiddenOffset(int k) const { return hOffset[k]; }
+
+    int weightOffset(int k) const { return wOffset[k]; }
+
+    int totalVisible() const { return total_v; }
+
+    int totalHidden() const { return total_h; }
+
+    // Índice de la característica de entrada de cada posición visible
+    const int *features() const { return featureIndex.data(); }
+
+    // Autocodificador k, construido sobre la memoria empaquetada
+    AE<KitNETActivation> *layer(int k) { return layers[k]; }
+
+    // Número de valores del bloque de parámetros y su inicio
+    size_t paramCount() const { return (size_t) 2 * wOffset[ae_num] + total_h + 3 * total_v; }
+
+    double *parameters() { return params; }
+
+    // Secciones del bloque de parámetros
+    double *encoderWeights() { return encW; }
+
+    double *decoderWeights() { return decW; }
+
+    double *encoderBiases() { return encB; }
+
+    double *decoderBiases() { return decB; }
+
+    double *minValues() { return min_v; }
+
+    double *maxValues() { return max_v; }
+
+    // Coste aproximado de un autocodificador (multiplicaciones por muestra), para repartir el trabajo entre hilos
+    int cost(int k) const {
+        return 2 * (wOffset[k + 1] - wOffset[k]) + vOffset[k + 1] - vOffset[k];
+    }
+
+    // Ejecuta los autocodificadores [begin, end) con el vector de instancia x y guarda el RMSE de cada uno en out (ae_num elementos)
+    void execute(const double *x, double *out, int begin, int end);
+
+    void execute(const double *x, double *out) { execute(x, out, 0, ae_num); }
+
+    // Igual con la normalización congelada y las variables temporales del llamador (sx y sz: totalVisible(),
+    // sy: totalHidden()). No modifica la capa, así que varios hilos pueden usarla a la vez
+    void execute(const double *x, double *out, double *sx, double *sy, double *sz, int begin, int end) const;
+
+    // Ejecuta un lote de rows vectores (separados por stride) en orden y guarda los errores en out (rows x ae_num)
+    void execute_batch(const double *X, int rows, int stride, double *out, int begin, int end);
+
+    // Entrena los autocodificadores [begin, end) con el vector de instancia x y guarda el RMSE de cada uno en out
+    void train(const double *x, double *out, int begin, int end);
+
+    void train(const double *x, double *out) { train(x, out, 0, ae_num); }
+
+    // Entrena un mini lote de rows vectores (separados por stride) y guarda los errores en out (rows x ae_num)
+    void train_batch(const double *X, int rows, int stride, double *out, int begin, int end);
+
+    void train_batch(const double *X, int rows, int stride, double *out) {
+        train_batch(X, rows, stride, out, 0, ae_num);
+    }
+};
+
+#endif //KITSUNE_CPP_ENSEMBLE_H
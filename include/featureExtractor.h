@@ -25,12 +25,22 @@ enum FileType {
     PCAP, PacketTSV, PacketCSV, FeatureCSV, FeatureTSV, OnlineNetDevice
 };
 
+// Cabecera del paquete que ha producido el último vector de instancia (vacía al leer vectores directamente)
+struct PacketInfo {
+    std::string srcMAC, dstMAC, srcIP, srcPort, dstIP, dstPort;
+
+    double size = 0, time = 0;
+
+    std::vector<double> values; // Vector de instancia leído directamente (FeatureCSV, FeatureTSV)
+};
+
 // Responsable de obtener vectores de características. Se puede leer desde archivos pcap, tsv o una línea de vectores se puede leer directamente desde tipos de archivos como FeatureCSV
 class FE {
 private:
     TsvReader *tsvReader = nullptr;
     NetStat *netStat = nullptr;     // = nullptr
     FileType fileType; // Tipo de archivo actual
+    PacketInfo packet; // Cabecera de nextVector, reutilizada entre paquetes para no reservar memoria por paquete
 public:
     // netStat usa el constructor de ventana de tiempo predeterminado y lee el archivo de características del paquete tsv de manera predeterminada
     FE(const char *filename, FileType ft = PacketTSV);
@@ -47,9 +57,22 @@ public:
     // Obtenga el siguiente vector de instancia y guárdelo como resultado
     int nextVector(double *result);
 
+    // Igual que nextVector y además guarda en info las direcciones, puertos, tamaño y tiempo del paquete
+    int nextPacket(double *result, PacketInfo &info);
+
+    // nextPacket en dos pasos que se pueden hacer en hilos distintos (uno cada uno):
+    // readPacket decodifica la siguiente fila del fichero en info (falso al final) y
+    // computeVector actualiza las estadísticas de netStat con el paquete y guarda el vector de instancia en result
+    bool readPacket(PacketInfo &info);
+
+    int computeVector(const PacketInfo &info, double *result);
+
     // Devuelve el tamaño del vector de instancia generado cada vez.
     inline int getVectorSize() { return netStat->getVectorSize(); }
 
+    // Estadísticas que producen los vectores (ventanas y disposición del vector de instancia)
+    const NetStat *getNetStat() const { return netStat; }
+
 };
 
 
@@ -0,0 +1,88 @@
+//
+// Muestreo de la puntuación por flujo: los flujos masivos solo se puntúan cada k paquetes o cuando cambian.
+//
+
+#ifndef KITSUNE_CPP_FLOWSAMPLER_H
+#define KITSUNE_CPP_FLOWSAMPLER_H
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include "featureExtractor.h"
+#include "netStat.h"
+
+
+// Configuración del muestreo
+struct FlowSamplingConfig {
+    double rateThreshold = 200; // Paquetes por segundo a partir de los cuales un flujo se muestrea
+
+    int every = 16; // Un flujo muestreado se puntúa al menos una vez cada every paquetes
+
+    // Cambio relativo de alguna estadística de HT_Hp respecto al último paquete puntuado del flujo que obliga a puntuar
+    double changeThreshold = 0.2;
+
+    double idleTimeout = 60; // Segundos (de marca de tiempo de los paquetes) tras los que se olvida un flujo muestreado
+};
+
+
+/**
+ *  FlowSampler: decide, a partir del vector de NetStat ya calculado (NetStat se actualiza con todos los paquetes),
+ *  si un paquete se puntúa con KitNET.
+ *
+ *  El flujo es el de HT_Hp (IP y puerto de origen y de destino) y su tasa se estima con el peso de HT_Hp en la primera
+ *  ventana: con paquetes a r por segundo el peso decae hacia r / (lambda ln 2), con lambda la primera ventana del
+ *  NetStat que produce los vectores, del que se toma también la posición de HT_Hp. Los flujos nuevos o lentos se puntúan
+ *  siempre; a los que superan rateThreshold se les puntúa el primer paquete, uno de cada every y cualquiera cuyas
+ *  estadísticas de HT_Hp (peso, media, varianza, radio, magnitud, covarianza y correlación) se alejen más de
+ *  changeThreshold de las del último paquete puntuado. Así las transferencias largas y constantes (copias de seguridad,
+ *  vídeo) cuestan una fracción de la ejecución sin perder sensibilidad con las conexiones nuevas ni con los cambios.
+ *  Solo se guarda estado de los flujos muestreados y los inactivos se olvidan. Se usa desde un único hilo
+ */
+class FlowSampler {
+private:
+    struct Flow {
+        std::vector<double> reference; // Estadísticas de HT_Hp del último paquete puntuado
+
+        int skipped = 0; // Paquetes sin puntuar desde entonces
+
+        double lastTime = 0;
+    };
+
+    FlowSamplingConfig config;
+
+    double lambda; // Factor de decaimiento de la primera ventana de NetStat, con el que se estima la tasa
+
+    int offset, length; // Bloque de HT_Hp dentro del vector de instancia
+
+    std::unordered_map<std::string, Flow> flows;
+
+    std::string key; // Clave del paquete actual, para no reservar memoria en cada llamada
+
+    double lastSweep = 0;
+
+    long long seen = 0, scored = 0;
+
+    // Olvida los flujos inactivos desde hace más de idleTimeout
+    void sweep(double now);
+
+public:
+    // Constructor, los parámetros son el NetStat que produce los vectores (p. ej. FE::getNetStat) y la configuración
+    FlowSampler(const NetStat &netStat, const FlowSamplingConfig &config = FlowSamplingConfig());
+
+    // Decide si se puntúa el paquete info, cuyo vector de instancia es x
+    bool admit(const PacketInfo &info, const double *x);
+
+    // Tasa estimada del flujo HT_Hp del vector x en paquetes por segundo
+    double flowRate(const double *x) const;
+
+    long long getSeen() const { return seen; }
+
+    long long getScored() const { return scored; }
+
+    long long getSkipped() const { return seen - scored; }
+
+    // Flujos muestreados de los que se guarda estado
+    size_t getSampledFlows() const { return flows.size(); }
+};
+
+#endif //KITSUNE_CPP_FLOWSAMPLER_H
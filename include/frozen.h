@@ -0,0 +1,77 @@
+//
+// Plan de inferencia congelado de un KitNET entrenado.
+//
+
+#ifndef KITSUNE_CPP_FROZEN_H
+#define KITSUNE_CPP_FROZEN_H
+
+#include <vector>
+#include "kitNET.h"
+
+
+/**
+ *  FrozenKitNET: modelo de solo inferencia compilado a partir de un KitNET entrenado (ver KitNET::freeze).
+ *
+ *  El plan es inmutable: la permutación de entrada está aplanada (CSR), la normalización está plegada en constantes
+ *  x * scale + offset (los valores máximos y mínimos ya no se actualizan), todos los parámetros están en un único bloque
+ *  alineado y las variables temporales se reservan al construirlo. execute es un único recorrido lineal:
+ *  reunir y normalizar, codificar, activar, decodificar, activar y RMSE para toda la capa integrada y después la de salida.
+ *  El resultado es el de KitNET::execute con la normalización congelada, salvo el redondeo de la multiplicación por scale
+ */
+class FrozenKitNET {
+private:
+    int inputSize;
+
+    int ae_num; // Número de autocodificadores de la capa integrada
+
+    int total_v, total_h; // Suma de las capas visibles y ocultas de la capa integrada
+
+    int out_v, out_h; // Tamaños del autocodificador de salida
+
+    std::vector<int> featureIndex; // Índice de la característica de entrada de cada posición visible
+
+    std::vector<int> vOffset, hOffset, wOffset; // Inicio de cada autocodificador (ae_num + 1 elementos)
+
+    // Bloque único de parámetros:
+    // encW | decW | encB | decB | scale | offset de la capa integrada y lo mismo para la capa de salida
+    double *params = nullptr;
+
+    double *encW, *decW, *encB, *decB, *scale, *offset;
+
+    double *outEncW, *outDecW, *outEncB, *outDecB, *outScale, *outOffset;
+
+    // Núcleos especializados por tamaño de cada capa (nullptr = denseForward), ver aeKernels.h
+    std::vector<DenseKernel> encKernels, decKernels;
+
+    DenseKernel outEncKernel, outDecKernel;
+
+    // Variables temporales: capa integrada (sx, sy, sz) y capa de salida (ox, oy, oz)
+    double *scratch = nullptr;
+
+    double *sx, *sy, *sz, *ox, *oy, *oz;
+
+public:
+    explicit FrozenKitNET(KitNET &model);
+
+    ~FrozenKitNET();
+
+    FrozenKitNET(const FrozenKitNET &) = delete;
+
+    FrozenKitNET &operator=(const FrozenKitNET &) = delete;
+
+    // Devuelve el error de reconstrucción del vector de instancia x
+    double execute(const double *x);
+
+    // Ejecución por lotes, X: rows x getInputSize()
+    void execute_batch(const double *X, int rows, double *result);
+
+    int getInputSize() const { return inputSize; }
+
+    // Tamaño de los parámetros en bytes
+    size_t bytes() const {
+        return ((size_t) 2 * wOffset[ae_num] + total_h + 3 * total_v + 2 * out_v * out_h + out_h + 3 * out_v) *
+               sizeof(double) + featureIndex.size() * sizeof(int);
+    }
+};
+
+#endif //KITSUNE_CPP_FROZEN_H
@@ -0,0 +1,92 @@
+//
+// Núcleos numéricos de las capas densas.
+//
+
+#ifndef KITSUNE_CPP_KERNELS_H
+#define KITSUNE_CPP_KERNELS_H
+
+#include <cstddef>
+#include "utils.h"
+
+/**
+ *  Núcleos de bajo nivel compartidos por Dense y por los autocodificadores empaquetados.
+ *
+ *  La matriz de pesos se guarda contigua, una fila por neurona de entrada (n_in filas, n_out columnas),
+ *  de modo que W[i * n_out + o] es el peso de la entrada i a la salida o.
+ *  Con esta disposición la propagación hacia adelante es una suma de filas escaladas (axpy), contigua y vectorizable,
+ *  y la retropropagación recorre cada fila una sola vez. El orden de las sumas es el mismo que el de la implementación
+ *  original con double**, por lo que los resultados son idénticos bit a bit.
+ */
+
+// y += a * x, en n elementos
+inline void axpy(double a, const double *KITSUNE_RESTRICT x, double *KITSUNE_RESTRICT y, int n) {
+    for (int i = 0; i < n; ++i)y[i] += a * x[i];
+}
+
+// Producto escalar en orden secuencial
+inline double dot(const double *KITSUNE_RESTRICT a, const double *KITSUNE_RESTRICT b, int n) {
+    double s = 0;
+    for (int i = 0; i < n; ++i)s += a[i] * b[i];
+    return s;
+}
+
+// GEMV de la propagación hacia adelante: y = bias + x * W (sin función de activación)
+inline void denseForward(const double *KITSUNE_RESTRICT W, const double *KITSUNE_RESTRICT bias,
+                         const double *KITSUNE_RESTRICT x, double *KITSUNE_RESTRICT y, int n_in, int n_out) {
+    for (int o = 0; o < n_out; ++o)y[o] = bias[o];
+    for (int i = 0; i < n_in; ++i)axpy(x[i], W + (std::size_t) i * n_out, y, n_out);
+}
+
+// Retropropagación fusionada. delta es el gradiente local de cada salida y deltaLr el mismo multiplicado por la tasa de aprendizaje.
+// En una sola pasada por fila calcula el error propagado a la entrada (con el peso antiguo) y aplica la actualización de rango 1.
+inline void denseBackward(double *KITSUNE_RESTRICT W, const double *KITSUNE_RESTRICT x,
+                          const double *KITSUNE_RESTRICT delta, const double *KITSUNE_RESTRICT deltaLr,
+                          double *KITSUNE_RESTRICT gIn, int n_in, int n_out) {
+    for (int i = 0; i < n_in; ++i) {
+        double *row = W + (std::size_t) i * n_out;
+        gIn[i] = dot(row, delta, n_out);
+        axpy(x[i], deltaLr, row, n_out);
+    }
+}
+
+// GEMM de la propagación hacia adelante de un lote: Y = bias + X * W, con X de rows x n_in e Y de rows x n_out.
+// Procesa 4 muestras a la vez para reutilizar cada fila de W; cada salida suma en el mismo orden que denseForward
+inline void denseForwardBatch(const double *KITSUNE_RESTRICT W, const double *KITSUNE_RESTRICT bias,
+                              const double *KITSUNE_RESTRICT X, double *KITSUNE_RESTRICT Y,
+                              int rows, int n_in, int n_out) {
+    int r = 0;
+    for (; r + 4 <= rows; r += 4) {
+        const double *x0 = X + (std::size_t) r * n_in, *x1 = x0 + n_in, *x2 = x1 + n_in, *x3 = x2 + n_in;
+        double *y0 = Y + (std::size_t) r * n_out, *y1 = y0 + n_out, *y2 = y1 + n_out, *y3 = y2 + n_out;
+        for (int o = 0; o < n_out; ++o)y0[o] = y1[o] = y2[o] = y3[o] = bias[o];
+        for (int i = 0; i < n_in; ++i) {
+            const double *row = W + (std::size_t) i * n_out;
+            const double a0 = x0[i], a1 = x1[i], a2 = x2[i], a3 = x3[i];
+            for (int o = 0; o < n_out; ++o) {
+                const double w = row[o];
+                y0[o] += a0 * w;
+                y1[o] += a1 * w;
+                y2[o] += a2 * w;
+                y3[o] += a3 * w;
+            }
+        }
+    }
+    for (; r < rows; ++r)denseForward(W, bias, X + (std::size_t) r * n_in, Y + (std::size_t) r * n_out, n_in, n_out);
+}
+
+// Retropropagación de un lote. D (rows x n_out) son los gradientes locales y DL los mismos ya multiplicados por la tasa de aprendizaje media.
+// Por cada fila de W calcula primero el error propagado de todas las muestras (con el peso antiguo) y después acumula las actualizaciones.
+// GIn (rows x n_in) puede ser nullptr si no se necesita el error propagado
+inline void denseBackwardBatch(double *KITSUNE_RESTRICT W, const double *KITSUNE_RESTRICT X,
+                               const double *KITSUNE_RESTRICT D, const double *KITSUNE_RESTRICT DL,
+                               double *KITSUNE_RESTRICT GIn, int rows, int n_in, int n_out) {
+    for (int i = 0; i < n_in; ++i) {
+        double *row = W + (std::size_t) i * n_out;
+        if (GIn != nullptr) {
+            for (int r = 0; r < rows; ++r)GIn[(std::size_t) r * n_in + i] = dot(row, D + (std::size_t) r * n_out, n_out);
+        }
+        for (int r = 0; r < rows; ++r)axpy(X[(std::size_t) r * n_in + i], DL + (std::size_t) r * n_out, row, n_out);
+    }
+}
+
+#endif //KITSUNE_CPP_KERNELS_H
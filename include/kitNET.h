@@ -7,7 +7,12 @@
 
 #include <vector>
 #include "neuralnet.h"
+#include "ensemble.h"
 #include "cluster.h"
+#include "workerPool.h"
+#include "serialize.h"
+
+class FrozenKitNET;
 
 
 /**
@@ -34,13 +39,58 @@ struct KitNETParam {
     // Clase auxiliar para agrupamiento
     Cluster *cluster = nullptr;
 
+    // Muestras de la fase de mapeo vistas hasta ahora
+    int fm_seen = 0;
+
+    // Fin anticipado de la fase de mapeo (ver KitNET::setAdaptiveFeatureMap), fm_check_interval = 0 lo desactiva
+    int fm_check_interval = 0;
+
+    int fm_min_samples = 0;
+
+    int fm_stable_checks = 3;
+
+    double fm_tolerance = 0;
+
+    // Mapa del último punto de control y puntos de control seguidos en los que no se ha movido
+    std::vector<std::vector<int> > *fm_last_map = nullptr;
+
+    int fm_stable = 0;
+
     // Incinerador de basuras
     ~KitNETParam() {
         if (cluster != nullptr)delete cluster;
+        delete fm_last_map;
     }
 };
 
 
+class KitNET;
+
+/**
+ *  KitNETContext: variables temporales de la ejecución constante de KitNET (ver KitNET::execute(x, context)).
+ *  Cada hilo que puntúa usa su propio contexto, creado para el modelo con el que se va a usar; el modelo se comparte
+ */
+class KitNETContext {
+private:
+    friend class KitNET;
+
+    // Bloque único: capa integrada (sx, sy, sz) y capa de salida (ox: errores de la capa integrada, on: normalizados,
+    // oy, oz)
+    double *scratch = nullptr;
+
+    double *sx, *sy, *sz, *ox, *on, *oy, *oz;
+
+public:
+    explicit KitNETContext(const KitNET &model);
+
+    ~KitNETContext() { alignedFree(scratch); }
+
+    KitNETContext(const KitNETContext &) = delete;
+
+    KitNETContext &operator=(const KitNETContext &) = delete;
+};
+
+
 /**
  *  KitNET Clase, principalmente a través de clustering, autoencoder implementa el algoritmo KitNET
  *
@@ -48,17 +98,16 @@ struct KitNETParam {
 
 class KitNET {
 private:
+    friend class KitNETContext;
+
     // Mapeo de características, guarde el codificador automático al que se asigna cada elemento del vector de instancia de característica.
     std::vector<std::vector<int> > *featureMap = nullptr;
 
-    // Autocodificador de capa integrado
-    AE **ensembleLayer = nullptr;
+    // Autocodificador de capa integrado, empaquetado en bloques contiguos
+    PackedEnsemble *ensembleLayer = nullptr;
 
     // Autoencoder de la capa de salida
-    AE *outputLayer = nullptr;
-
-    // El vector de entrada de la capa de integración
-    double **ensembleInput = nullptr;
+    AE<KitNETActivation> *outputLayer = nullptr;
 
     // Vector de entrada de la capa de salida
     double *outputInput = nullptr;
@@ -66,9 +115,55 @@ private:
     // Parámetros necesarios para inicializar el codificador automático
     KitNETParam *kitNetParam = nullptr;
 
+    // Tamaño del vector de instancia de entrada (separación entre filas en los lotes)
+    int inputSize = 0;
+
+    // Tamaño del mini lote de train_batch, 1 mantiene el SGD muestra a muestra
+    int batchSize = 1;
+
+    // Búfer del entrenamiento por lotes: errores de la capa integrada, una fila por muestra
+    std::vector<double> batchOutputInput;
+
+    // Entrena un mini lote de rows muestras con el mapa de características ya inicializado
+    void trainChunk(const double *X, int rows, double *result);
+
+    // Grupo de hilos del modo paralelo (nullptr en modo secuencial)
+    WorkerPool *pool = nullptr;
+
+    // Reparto de la capa integrada entre los hilos: el hilo w procesa los autocodificadores [partition[w], partition[w + 1])
+    std::vector<int> partition;
+
+    // Reparte la capa integrada en rangos contiguos de coste similar, uno por hilo
+    void partitionEnsemble();
+
+    // Hiperparámetros, se conservan después de la inicialización para poder guardar el modelo
+    double ensembleVhRate = 0.75, outputVhRate = 0.75, ensembleLearningRate = 0.1, outputLearningRate = 0.1;
+
+    // Fichero del modelo cargado con load (nullptr si el modelo se ha entrenado en este proceso)
+    MappedFile *modelFile = nullptr;
+
+    // Copia convertida de los parámetros cuando el fichero no se puede usar directamente (máquina big-endian)
+    double *modelMemory = nullptr;
+
+    // Construye las capas sobre los bloques de parámetros (sin copiarlos), outH es la capa oculta de la de salida
+    void bindParameters(double *ensembleParams, double *outputParams, int outH);
+
     // Inicializar KitNET, inicializar según parámetros característicos, etc.
     void init();
 
+    // Muestras con las que se ha construido el mapa de características (0 si se ha proporcionado)
+    int fmSamples = 0;
+
+    // Punto de control de la fase de mapeo adaptativa: recalcula el mapa, mide cuánto se ha movido desde el anterior
+    // e inicializa los autocodificadores si lleva fm_stable_checks puntos de control estable
+    void checkFeatureMap();
+
+    // Constructor vacío, usado por load
+    KitNET() {}
+
+    // Construye el modelo a partir de modelFile
+    void readModel();
+
 public:
 
     // Hay dos tipos de constructores, uno es para proporcionar directamente el mapeo de características. El otro es para entrenar el mapeo de características basado en parámetros, que se realizará después del entrenamiento
@@ -79,7 +174,13 @@ public:
     // 4. La tasa de aprendizaje de la capa de integración 5. La tasa de aprendizaje de la capa de salida (todas predeterminadas 0.1)
     KitNET(std::vector<std::vector<int> > *fm, double ensemble_vh_rate = 0.75, double output_vh_rate = 0.75,
            double ensemble_learning_rate = 0.1, double output_learning_rate = 0.1) {
+        ensembleVhRate = ensemble_vh_rate;
+        outputVhRate = output_vh_rate;
+        ensembleLearningRate = ensemble_learning_rate;
+        outputLearningRate = output_learning_rate;
         featureMap = fm;
+        for (auto &i : *featureMap)
+            for (int j : i)inputSize = std::max(inputSize, j + 1);
         kitNetParam = new KitNETParam;
         kitNetParam->ensemble_learning_rate = ensemble_learning_rate;
         kitNetParam->ensemble_vh_rate = ensemble_vh_rate;
@@ -97,6 +198,11 @@ public:
     // 6. La tasa de aprendizaje de la capa de integración 7. La tasa de aprendizaje de la capa de salida(todas predeterminadas 0.1)
     KitNET(int n, int maxAE, int fm_train_num, double ensemble_vh_rate = 0.75, double output_vh_rate = 0.75,
            double ensemble_learning_rate = 0.1, double output_learning_rate = 0.1) {
+        ensembleVhRate = ensemble_vh_rate;
+        outputVhRate = output_vh_rate;
+        ensembleLearningRate = ensemble_learning_rate;
+        outputLearningRate = output_learning_rate;
+        inputSize = n;
         kitNetParam = new KitNETParam;
         kitNetParam->ensemble_learning_rate = ensemble_learning_rate;
         kitNetParam->ensemble_vh_rate = ensemble_vh_rate;
@@ -117,6 +223,89 @@ public:
     // Propagación del término anterior, devuelve el error de reconstrucción de los datos actuales
     double execute(const double *x);
 
+    // Ejecución constante y reentrante: la normalización está congelada (los valores máximos y mínimos no se
+    // actualizan) y todas las variables temporales están en context, así que varios hilos pueden puntuar a la vez con el
+    // mismo modelo, cada uno con su contexto. Coincide con execute mientras x no amplíe los rangos de normalización.
+    // Siempre es secuencial (no usa el grupo de hilos de setThreads)
+    double execute(const double *x, KitNETContext &context) const;
+
+    void execute_batch(const double *X, int rows, double *result, KitNETContext &context) const;
+
+    // Entrenamiento por lotes de rows vectores contiguos (X: rows x getInputSize()), p. ej. desde una caché de características.
+    // Las muestras de la fase de mapeo de características actualizan el clúster por bloques; el resto se entrena en mini lotes de getBatchSize().
+    // Si result no es nullptr guarda el error de reconstrucción de cada muestra (0 en la fase de mapeo)
+    void train_batch(const double *X, int rows, double *result = nullptr);
+
+    // Ejecución por lotes de rows vectores contiguos (X: rows x getInputSize()), en orden, guardando cada error en result.
+    // Equivale a llamar a execute con cada vector, pero en modo paralelo cada hilo recorre todo el lote con su parte de la capa integrada
+    void execute_batch(const double *X, int rows, double *result);
+
+    // Modo paralelo dentro del paquete: reparte la capa integrada entre threads hilos persistentes (1 = secuencial).
+    // spin son las iteraciones de espera activa de los hilos antes de dormir
+    void setThreads(int threads, int spin = 20000);
+
+    // Establece el tamaño del mini lote de train_batch (1 equivale a llamar a train con cada muestra)
+    void setBatchSize(int size) {
+        if (size < 1) {
+            fprintf(stderr, "KitNET: the batch size must be positive\n");
+            throw -1;
+        }
+        batchSize = size;
+    }
+
+    int getBatchSize() const { return batchSize; }
+
+    // Fin anticipado de la fase de mapeo (solo con el constructor 2, antes de que termine): cada check_interval muestras,
+    // a partir de min_samples, se recalcula el mapa de características y se compara con el del punto de control anterior.
+    // Si la fracción de características cuyo grupo ha cambiado no supera tolerance durante stable_checks puntos de control
+    // seguidos, los autocodificadores se construyen con ese mapa sin esperar a fm_train_num, que queda como límite superior
+    void setAdaptiveFeatureMap(int check_interval, int stable_checks = 3, int min_samples = 0, double tolerance = 0);
+
+    // Muestras usadas por la fase de mapeo (las vistas hasta ahora si todavía no ha terminado)
+    int getFMSamples() const { return kitNetParam != nullptr ? kitNetParam->fm_seen : fmSamples; }
+
+    // Fracción de características cuyo grupo es distinto en los dos mapas (0 = mismo agrupamiento, sin importar el orden)
+    static double featureMapDistance(const std::vector<std::vector<int> > &a, const std::vector<std::vector<int> > &b);
+
+    // Si el mapa de características y los autocodificadores ya están construidos (fin de la fase de mapeo)
+    bool isInitialized() const { return featureMap != nullptr; }
+
+    // Acceso al modelo entrenado (nullptr antes de la inicialización)
+    const std::vector<std::vector<int> > *getFeatureMap() const { return featureMap; }
+
+    // Capas del modelo. Las capas de un modelo cargado se construyen una vez sobre la proyección del fichero y no se
+    // sustituyen nunca, así que estos punteros son válidos durante toda la vida del modelo
+    PackedEnsemble *getEnsembleLayer() { return ensembleLayer; }
+
+    AE<KitNETActivation> *getOutputLayer() { return outputLayer; }
+
+    // Tamaño del vector de instancia de entrada
+    int getInputSize() const { return inputSize; }
+
+    // Hiperparámetros
+    double getEnsembleVhRate() const { return ensembleVhRate; }
+
+    double getOutputVhRate() const { return outputVhRate; }
+
+    double getEnsembleLearningRate() const { return ensembleLearningRate; }
+
+    double getOutputLearningRate() const { return outputLearningRate; }
+
+    // Compila el modelo entrenado en un plan de inferencia inmutable (ver frozen.h); el llamador libera el resultado
+    FrozenKitNET *freeze();
+
+    // Guarda el modelo entrenado (mapa de características, pesos, umbrales, normalización e hiperparámetros) en un
+    // fichero binario versionado y little-endian. Los bloques de parámetros están alineados para poder proyectarlos con mmap
+    void save(const char *filename);
+
+    // Carga un modelo guardado con save. En POSIX el fichero se proyecta con mmap privado y las capas usan los pesos
+    // directamente desde las páginas compartidas entre procesos; una página solo se copia cuando se escribe (train, o
+    // execute, que actualiza la normalización, al final de cada bloque).
+    // Hilos: igual que con un modelo entrenado en este proceso, varios hilos pueden llamar a la vez a la ejecución
+    // constante (con KitNETContext), pero ninguna operación que modifica el modelo (train, train_batch, execute y
+    // execute_batch sin contexto, setThreads, escrituras a través de las capas) puede solaparse con ellas
+    static KitNET *load(const char *filename);
+
 
 };
 
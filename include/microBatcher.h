@@ -0,0 +1,107 @@
+//
+// Planificador de mini lotes con latencia acotada para la ejecución de KitNET.
+//
+
+#ifndef KITSUNE_CPP_MICROBATCHER_H
+#define KITSUNE_CPP_MICROBATCHER_H
+
+#include <vector>
+#include <chrono>
+#include <functional>
+#include "kitNET.h"
+
+
+// Configuración del planificador
+struct MicroBatchConfig {
+    int maxBatch = 64; // Tamaño máximo del lote
+
+    double deadlineUs = 200; // Espera máxima del vector más antiguo del lote, en microsegundos
+
+    // Objetivo del percentil 99 de la latencia (llegada -> puntuación) en microsegundos. 0 = tamaño de lote fijo (maxBatch).
+    // La llegada es la que se pasa a submit (en Pipeline, la decodificación del paquete)
+    // Con objetivo el tamaño se ajusta cada window puntuaciones: se reduce a la mitad si el p99 lo supera
+    // y crece en uno si queda por debajo del 80 %
+    double p99TargetUs = 0;
+
+    int window = 1024;
+};
+
+
+/**
+ *  MicroBatcher: acumula vectores hasta tener un lote completo o hasta que vence el plazo del más antiguo,
+ *  y los puntúa juntos con KitNET::execute_batch, entregando las puntuaciones en orden de llegada.
+ *
+ *  Todo se llama desde un mismo hilo (el de puntuación): submit añade un vector y puntúa el lote si está completo,
+ *  poll puntúa el lote pendiente si ha vencido su plazo (hay que llamarlo mientras no llegan vectores)
+ */
+class MicroBatcher {
+public:
+    // Callback de cada puntuación: número de paquete, error de reconstrucción y latencia en microsegundos
+    typedef std::function<void(long long packet, double score, double latencyUs)> ScoreCallback;
+
+    typedef std::chrono::steady_clock Clock;
+
+private:
+    KitNET *model;
+
+    int n; // Tamaño del vector de instancia
+
+    MicroBatchConfig config;
+
+    int batchSize; // Tamaño de lote actual
+
+    int count = 0; // Vectores pendientes
+
+    std::vector<double> X; // Vectores pendientes, maxBatch x n
+
+    std::vector<long long> packets;
+
+    std::vector<Clock::time_point> arrivals;
+
+    std::vector<double> scores;
+
+    std::vector<double> latencies; // Latencias de la ventana actual
+
+    double p99 = 0; // Percentil 99 de la última ventana completa
+
+    long long batches = 0, scored = 0;
+
+    ScoreCallback onScore;
+
+    // Ajusta el tamaño de lote con el p99 de la ventana
+    void adapt();
+
+public:
+    // Constructor, los parámetros son el modelo ya entrenado (no pasa a ser propiedad del planificador) y la configuración
+    MicroBatcher(KitNET *model, const MicroBatchConfig &config = MicroBatchConfig());
+
+    void setScoreCallback(const ScoreCallback &callback) { onScore = callback; }
+
+    // Añade el vector x del paquete packet, que llegó en arrival (la latencia y el plazo se miden desde ahí); si el lote
+    // queda completo lo puntúa. Devuelve si se ha puntuado un lote
+    bool submit(const double *x, long long packet, Clock::time_point arrival);
+
+    // Igual, con el vector llegando ahora
+    bool submit(const double *x, long long packet) { return submit(x, packet, Clock::now()); }
+
+    // Puntúa el lote pendiente si ha vencido el plazo de su vector más antiguo. Devuelve si se ha puntuado
+    bool poll();
+
+    // Puntúa el lote pendiente inmediatamente
+    void flush();
+
+    // Microsegundos hasta que vence el plazo del lote pendiente (negativo si ya ha vencido, 0 si no hay lote)
+    double untilDeadlineUs() const;
+
+    int pending() const { return count; }
+
+    int getBatchSize() const { return batchSize; }
+
+    double getP99Us() const { return p99; }
+
+    long long getBatches() const { return batches; }
+
+    long long getScored() const { return scored; }
+};
+
+#endif //KITSUNE_CPP_MICROBATCHER_H
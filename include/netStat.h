@@ -265,6 +265,9 @@ private:
     //4. HT_Hp: mantiene las estadísticas de ancho de banda unidimensionales del flujo de envío del puerto del host de origen y las estadísticas bidimensionales del flujo de envío del puerto del host de origen (7 funciones). Esto es diferente del HT_H anterior en que el valor clave es ip + puerto , considerando cada puerto
     IncStatDB *HT_jit = nullptr, *HT_MI = nullptr, *HT_H = nullptr, *HT_Hp = nullptr;
 
+    // Claves compuestas (MAC + IP, IP + IP, IP + puerto), reutilizadas entre paquetes para no reservar memoria por paquete
+    std::string key1, key2;
+
 public:
     // Constructor, los parámetros son lambdas
     NetStat(const std::vector<double> &l);
@@ -282,6 +285,15 @@ public:
     // Devuelve la dimensión del vector de instancia estadístico generado, actualmente cada lambda corresponde a 20 características
     int getVectorSize() { return lambdas.size() * 20; }
 
+    // Ventanas de tiempo (factores de decaimiento), en el orden del vector de instancia
+    const std::vector<double> &getLambdas() const { return lambdas; }
+
+    // Disposición del vector de instancia: bloques MI (3 estadísticas por ventana), H (7), jit (3) y Hp (7), y en cada
+    // bloque cada estadística para todas las ventanas seguidas, empezando por el peso. Inicio y tamaño del bloque Hp
+    int getHpOffset() const { return 13 * (int) lambdas.size(); }
+
+    int getHpLength() const { return 7 * (int) lambdas.size(); }
+
     // Destructor, elimine cuatro instancias de nuevo
     ~NetStat() {
         delete HT_H;
@@ -7,79 +7,163 @@
 
 #include <cstdio>
 #include <cstring>
+#include <vector>
 #include "utils.h"
+#include "kernels.h"
+#include "aeKernels.h"
 
 
 /**
- *  Capa de red simple y completamente conectada
+ *  Capa de red simple y completamente conectada.
+ *  Activation es la política de activación (ver utils.h), p. ej. SigmoidActivation o IdentityActivation
  */
+template<class Activation>
 class Dense {
 private:
     int n_in;    // Escala de entrada
 
     int n_out;    // Escala de salida
 
-    double **W = nullptr; // Peso de la conexión
+    double *W = nullptr; // Peso de la conexión, bloque contiguo alineado de n_in filas y n_out columnas (ver kernels.h)
 
     double *bias = nullptr; // Umbral
 
-    double (*activation)(double); // Puntero de función para la función de activación
-
-    double (*activationDerivative)(double); // Puntero de función de la derivada de la función de activación (el parámetro es el valor de la función de la función de activación)
-
     double learning_rate; // Tasa de aprendizaje
 
     double *inputValue = nullptr; //Variable temporal para guardar el valor de entrada
 
     double *outputValue = nullptr; // Variable temporal del valor de salida guardado
 
+    double *delta = nullptr; // Gradiente local de cada salida durante la retropropagación
+
+    // Valores guardados del último lote (rows x n_in, rows x n_out) y gradientes locales del lote
+    std::vector<double> batchInput, batchOutput, batchDelta;
+
+    bool ownsParams = true; // Si W y bias pertenecen a esta capa (falso cuando viven en memoria externa)
+
+    DenseKernel forwardKernel = nullptr; // GEMV especializado para n_in x n_out (nullptr = denseForward)
+
+    // Reserva las variables temporales
+    void allocTemporaries();
+
 public:
-    // Constructor, los parámetros son el número de neuronas de entrada, el número de neuronas de salida, la función de activación, la derivada de la función de activación, la tasa de aprendizaje (por defecto 0,1)
-    Dense(int inSize, int outSize, double (*activationFunc)(double), double (*activationDerivativeFunc)(double),
-          double lr = 0.1);
+    // Constructor, los parámetros son el número de neuronas de entrada, el número de neuronas de salida, la tasa de aprendizaje (por defecto 0,1)
+    Dense(int inSize, int outSize, double lr = 0.1);
+
+    // Constructor sobre memoria externa: weights (n_in x n_out) y biases (n_out) no se inicializan ni se liberan
+    Dense(int inSize, int outSize, double lr, double *weights, double *biases);
 
     ~Dense();
 
     //Propagación hacia adelante, el tercer parámetro indica si se deben guardar las variables temporales de los valores de entrada y salida(falso cuando solo se envía y verdadero cuando se requiere bp después de la propagación).
     void feedForward(const double *input, double *output, bool saveValue = false);
 
+    // Propagación hacia adelante sin guardar nada en la capa, se puede llamar desde varios hilos a la vez
+    void forward(const double *input, double *output) const;
+
     // Retropropagar el error y guardar el error propagado a la capa anterior en g. La capacidad de g debe ser máxima (n_in, n_out
     void BackPropagation(double *g);
+
+    // Propagación hacia adelante de un lote de rows muestras (X: rows x n_in, Y: rows x n_out).
+    // Si saveValue es verdadero guarda el lote para BackPropagationBatch
+    void feedForwardBatch(const double *X, double *Y, int rows, bool saveValue = false);
+
+    // Retropropaga el error de un lote, G (rows x n_out), y guarda el error propagado a la capa anterior en GIn (rows x n_in, puede ser nullptr).
+    // El gradiente se promedia en el lote, así que con rows = 1 equivale exactamente a BackPropagation
+    void BackPropagationBatch(const double *G, double *GIn, int rows);
+
+    // Acceso a los parámetros (cuantización, serialización, etc.)
+    int inSize() const { return n_in; }
+
+    int outSize() const { return n_out; }
+
+    double *weights() { return W; }
+
+    double *biases() { return bias; }
+
+    double learningRate() const { return learning_rate; }
 };
 
 
+/**
+ *  Memoria externa de los parámetros de un autocodificador (pesos, umbrales y valores de normalización),
+ *  p. ej. una porción de los bloques contiguos de un PackedEnsemble
+ */
+struct AEStorage {
+    double *encW, *encB; // Pesos (visible x oculta) y umbrales del codificador
+    double *decW, *decB; // Pesos (oculta x visible) y umbrales del decodificador
+    double *min_v, *max_v; // Valores de normalización
+};
+
 /**
  *  
 Clase de autocodificador, manteniendo dos capas completamente conectadas (codificador y decodificador)
+ *  Ambas capas usan la política de activación Activation (por defecto la sigmoide)
  */
+template<class Activation = SigmoidActivation>
 class AE {
 private:
     int visible_size; // El tamaño de la capa visible.
 
     int hidden_size; // Tamaño de capa oculta
 
-    Dense *encoder = nullptr, *decoder = nullptr; //Red neuronal de dos capas, codificador y decodificador
+    Dense<Activation> *encoder = nullptr, *decoder = nullptr; //Red neuronal de dos capas, codificador y decodificador
 
     double *min_v = nullptr, *max_v = nullptr; // 0-1 valores máximos y mínimos normalizados que deben mantenerse
 
     double *tmp_x, *tmp_y, *tmp_z, *tmp_g; // Variables temporales
 
-    // 0 - 1 normalizado, el resultado se almacena en tmp_x
-    void normalize(const double *x);
+    bool ownsParams = true; // Si min_v y max_v pertenecen a este autocodificador
+
+    // Reserva las variables temporales
+    void allocTemporaries();
+
+    // Variables temporales del entrenamiento por lotes (una fila por muestra)
+    std::vector<double> batch_x, batch_y, batch_z, batch_g, batch_gh;
+
+    // 0 - 1 normalizado, el resultado se almacena en out
+    void normalize(const double *x, double *out);
+
+    // Igual sin actualizar los valores máximos y mínimos
+    void normalizeFrozen(const double *x, double *out) const;
 
 public:
     // Constructor, el parámetro es el número de capas explícitas, capas ocultas, tasa de aprendizaje, por defecto 0.01
     AE(int v_sz, int h_sz, double _learning_rate = 0.01);
 
+    // Constructor sobre memoria externa: los parámetros de storage no se inicializan ni se liberan
+    AE(int v_sz, int h_sz, double _learning_rate, const AEStorage &storage);
+
     // Incinerador de basuras
     ~AE();
 
     // Reconstrucción, devuelve el error medio de raíz reconstruido
     double reconstruct(const double *x);
 
+    // Reconstrucción con la normalización congelada y las variables temporales del llamador (tx y tz: capa visible,
+    // ty: capa oculta). No modifica el autocodificador, así que varios hilos pueden usarlo a la vez
+    double reconstruct(const double *x, double *tx, double *ty, double *tz) const;
+
     // Entrenamiento, devuelve el error medio de raíz reconstruido
     double train(const double *x);
 
+    // Entrenamiento por mini lotes de rows muestras (X: rows x visible_size), un solo paso de SGD con el gradiente medio.
+    // Si rmse no es nullptr guarda el error de cada muestra (antes de la actualización). Devuelve el error medio del lote
+    double train_batch(const double *X, int rows, double *rmse = nullptr);
+
+    // Acceso a las capas y a los valores de normalización
+    int visibleSize() const { return visible_size; }
+
+    int hiddenSize() const { return hidden_size; }
+
+    Dense<Activation> *getEncoder() { return encoder; }
+
+    Dense<Activation> *getDecoder() { return decoder; }
+
+    double *minValues() { return min_v; }
+
+    double *maxValues() { return max_v; }
+
 };
 
 
@@ -0,0 +1,129 @@
+//
+// Protección frente a sobrecarga: descarte adaptativo de trabajo, primero de la puntuación y después de NetStat.
+//
+
+#ifndef KITSUNE_CPP_OVERLOAD_H
+#define KITSUNE_CPP_OVERLOAD_H
+
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include "featureExtractor.h"
+
+
+// Configuración del controlador. Las presiones van de 0 (sin cola ni retraso) a 1 (cola llena o retraso máximo)
+struct OverloadConfig {
+    // Presión a partir de la cual se deja de puntuar una parte de los paquetes y proporción máxima que se deja de puntuar
+    double scoreStart = 0.5, scoreMaxShed = 0.9;
+
+    // Presión a partir de la cual se deja de actualizar NetStat con una parte de los flujos y proporción máxima de flujos
+    double statStart = 0.9, statMaxShed = 0.5;
+
+    // Escalón de la proporción de flujos descartados: solo cambia en múltiplos de statStep y cuando la proporción
+    // deseada se aleja al menos un escalón entero, para que los flujos no entren y salgan con cada paquete. Debe ser
+    // mayor que las oscilaciones de la proporción suavizada; si no, el umbral salta entre dos escalones vecinos
+    double statStep = 0.125;
+
+    // Retraso (en segundos) respecto al ritmo de las marcas de tiempo de los paquetes que cuenta como presión 1.
+    // 0 = no se mira el retraso
+    double maxLag = 0;
+
+    // Si la ocupación de las colas cuenta como presión. Solo tiene sentido cuando el origen no espera a que haya sitio
+    // (captura en vivo): leyendo un fichero la decodificación se bloquea con la cola llena, las colas están llenas casi
+    // siempre y no indican sobrecarga, así que la presión debe venir solo del retraso (maxLag > 0).
+    // Con false y maxLag = 0 no se descarta nada
+    bool queuePressure = false;
+
+    double smoothing = 0.05; // Peso de cada observación en la media móvil exponencial de la presión
+};
+
+// Métricas del controlador
+struct OverloadMetrics {
+    long long packets = 0; // Paquetes observados por la etapa de estadísticas
+
+    long long statShed = 0; // Paquetes que no han actualizado NetStat
+
+    long long scorable = 0; // Vectores que se podían descartar (ejecución, no entrenamiento)
+
+    long long scoreShed = 0; // Vectores que no se han puntuado
+
+    double statRate = 0, scoreRate = 0; // Proporciones de descarte actuales (statRate es el umbral de flujos)
+
+    double statPressure = 0, scorePressure = 0; // Presiones suavizadas actuales
+
+    double peakLag = 0; // Mayor retraso observado en segundos
+};
+
+
+/**
+ *  OverloadController: decide qué trabajo se descarta cuando el canal no da abasto, en lugar de dejar que el núcleo
+ *  tire paquetes al azar (lo que estropea tanto las estadísticas de IncStat como las puntuaciones).
+ *
+ *  La presión de cada etapa es el retraso respecto a las marcas de tiempo de los paquetes (con maxLag) y, con
+ *  queuePressure, la ocupación de su cola de entrada; la proporción de descarte crece linealmente desde el umbral de
+ *  inicio hasta el máximo con presión 1:
+ *    1. admitScore: con presión moderada no se puntúa una parte de los vectores, repartida uniformemente
+ *       (NetStat se sigue actualizando con todos los paquetes, así que las estadísticas no se degradan)
+ *    2. admitStats: solo con presión extrema se deja de actualizar NetStat, y por flujo: el par de IPs se resume en un
+ *       hash y se descartan los flujos cuyo hash cae por debajo de un umbral, así que los dos sentidos de un flujo
+ *       corren la misma suerte. El umbral sigue a la proporción de descarte en escalones de statStep con histéresis
+ *       de un escalón, de modo que un flujo solo cambia de estado cuando el umbral cruza su hash, unas pocas veces
+ *       por episodio de sobrecarga y no con cada paquete. Un flujo que cambia de estado durante su vida tiene un hueco
+ *       en su historia de NetStat; los que no cambian mantienen estadísticas coherentes.
+ *  Las decisiones de estadísticas y de puntuación se toman desde hilos distintos (uno cada una);
+ *  getMetrics y printMetrics se pueden llamar desde cualquier hilo
+ */
+class OverloadController {
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    OverloadConfig config;
+
+    // Estado de la etapa de estadísticas
+    double statPressure = 0;
+
+    double statThreshold = 0; // Se descartan los flujos con hash por debajo, múltiplo de statStep
+
+    bool started = false;
+
+    Clock::time_point wallStart;
+
+    double packetStart = 0;
+
+    // Estado de la etapa de puntuación
+    double scorePressure = 0;
+
+    double scoreCredit = 0; // Descarte acumulado, se descarta un vector cada vez que llega a 1
+
+    // Métricas, escritas por su etapa y leídas desde cualquier hilo
+    std::atomic<long long> packets, statShed, scorable, scoreShed;
+
+    std::atomic<double> statRate, scoreRate, statPressureNow, scorePressureNow, peakLag;
+
+    std::atomic<double> lagPressure; // Presión del retraso del último paquete, escrita por la etapa de estadísticas
+
+    // Proporción de descarte para una presión
+    static double shedRate(double pressure, double start, double maxShed);
+
+public:
+    OverloadController(const OverloadConfig &config = OverloadConfig());
+
+    // Etapa de estadísticas: presión de una ocupación de cola depth/capacity y del retraso del paquete.
+    // Devuelve si el paquete debe actualizar NetStat; con sheddable = false (paquetes de entrenamiento) solo se
+    // actualiza la presión y el paquete siempre se admite
+    bool admitStats(const PacketInfo &info, size_t depth, size_t capacity, bool sheddable = true);
+
+    // Etapa de puntuación: presión de una ocupación de cola depth/capacity y del último retraso visto por la etapa de
+    // estadísticas. Devuelve si el vector debe puntuarse
+    bool admitScore(size_t depth, size_t capacity);
+
+    // Hash del flujo del paquete en [0, 1), igual en los dos sentidos
+    static double flowHash(const PacketInfo &info);
+
+    OverloadMetrics getMetrics() const;
+
+    // Métricas en formato de texto de Prometheus
+    void printMetrics(FILE *fp = stdout) const;
+};
+
+#endif //KITSUNE_CPP_OVERLOAD_H
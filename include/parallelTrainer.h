@@ -0,0 +1,47 @@
+//
+// Entrenamiento fuera de línea de KitNET con paralelismo de datos y promediado de pesos.
+//
+
+#ifndef KITSUNE_CPP_PARALLELTRAINER_H
+#define KITSUNE_CPP_PARALLELTRAINER_H
+
+#include <vector>
+#include "kitNET.h"
+#include "workerPool.h"
+
+
+/**
+ *  ParallelTrainer: entrena un KitNET a partir de una caché de características con varias réplicas en paralelo.
+ *
+ *  La fase de mapeo de características se hace en serie con el propio modelo (es el agrupamiento, barato frente a la
+ *  retropropagación). Después se crean replicas - 1 copias del modelo con el mismo mapa y los mismos pesos iniciales,
+ *  el resto de la caché se reparte en tramos contiguos, uno por réplica, y cada réplica entrena su tramo con train_batch
+ *  (mismo tamaño de mini lote que el modelo) en su propio hilo, sin compartir memoria.
+ *  Cada syncInterval muestras por réplica los parámetros se fusionan en el modelo y se copian de vuelta a las réplicas:
+ *  los pesos y umbrales se promedian y los valores de normalización se combinan (mínimo de los mínimos y máximo de los
+ *  máximos, que es el rango de todas las muestras vistas). Al terminar el modelo contiene el resultado fusionado.
+ *  Con una réplica equivale a train_batch
+ */
+class ParallelTrainer {
+private:
+    int replicas;
+
+    long long syncInterval; // Muestras por réplica entre dos fusiones
+
+    WorkerPool pool;
+
+public:
+    // Constructor, los parámetros son el número de réplicas (un hilo por réplica, incluido el llamador),
+    // las muestras por réplica entre dos fusiones y las iteraciones de espera activa de los hilos
+    explicit ParallelTrainer(int replicas, long long sync_interval = 1000, int spin = 20000);
+
+    int getReplicas() const { return replicas; }
+
+    long long getSyncInterval() const { return syncInterval; }
+
+    // Entrena model con rows vectores contiguos (X: rows x model.getInputSize()). El modelo puede estar todavía en la fase
+    // de mapeo de características, en cuyo caso las primeras muestras se usan para completarla
+    void train(KitNET &model, const double *X, long long rows);
+};
+
+#endif //KITSUNE_CPP_PARALLELTRAINER_H
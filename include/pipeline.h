@@ -0,0 +1,145 @@
+//
+// Canal de procesamiento por etapas: decodificación -> NetStat -> KitNET, cada una en su hilo.
+//
+
+#ifndef KITSUNE_CPP_PIPELINE_H
+#define KITSUNE_CPP_PIPELINE_H
+
+#include <vector>
+#include <atomic>
+#include <functional>
+#include "kitNET.h"
+#include "featureExtractor.h"
+#include "spscRing.h"
+#include "microBatcher.h"
+#include "overload.h"
+#include "flowSampler.h"
+
+
+// Fija el hilo actual a la CPU cpu (solo Linux; en el resto, o con cpu < 0, no hace nada). Devuelve si se ha fijado
+bool pinCurrentThread(int cpu);
+
+
+// Configuración del canal
+struct PipelineConfig {
+    size_t ringCapacity = 1024; // Ranuras de cada cola entre etapas
+
+    // CPU de cada etapa (-1 = sin fijar)
+    int decodeCpu = -1, featureCpu = -1, scoreCpu = -1;
+
+    int spin = 2000; // Iteraciones de espera activa antes de ceder la CPU cuando una cola está vacía o llena
+
+    // Ejecución por mini lotes con latencia acotada (ver MicroBatcher) después del entrenamiento
+    bool microBatch = false;
+
+    MicroBatchConfig batch;
+
+    // Protección frente a sobrecarga (no pasa a ser propiedad del canal, nullptr = no se descarta nada): la etapa de
+    // estadísticas le pasa la ocupación de la primera cola y la de puntuación la de la segunda. Leyendo un fichero las
+    // colas siempre se llenan, así que la presión debe venir del retraso (OverloadConfig::maxLag)
+    OverloadController *overload = nullptr;
+
+    // Muestreo por flujo de la puntuación después del entrenamiento (no pasa a ser propiedad del canal, nullptr = se
+    // puntúa todo): lo consulta la etapa de estadísticas con cada vector recién calculado
+    FlowSampler *sampler = nullptr;
+};
+
+// Estadísticas de una etapa
+struct StageStats {
+    long long items = 0; // Elementos procesados
+
+    long long emptyWaits = 0; // Veces que la cola de entrada estaba vacía (la etapa anterior es más lenta)
+
+    long long fullWaits = 0; // Veces que la cola de salida estaba llena (la etapa siguiente es más lenta)
+
+    double meanDepth = 0; // Ocupación media de la cola de entrada al tomar cada elemento
+
+    size_t maxDepth = 0; // Ocupación máxima de la cola de entrada
+
+    double seconds = 0; // Duración de la etapa
+};
+
+
+/**
+ *  Pipeline: ejecuta FE + KitNET como tres etapas en hilos distintos, unidas por colas SPSC de ranuras reservadas
+ *  al construirlo. Las cadenas de cada ranura conservan su capacidad entre vueltas, así que por paquete no se reserva
+ *  memoria (salvo NetStat la primera vez que ve un flujo) ni se copia nada más que el propio paquete y su vector:
+ *    1. decodificación: FE::readPacket escribe la cabecera directamente en una ranura de la primera cola
+ *    2. estadísticas: FE::computeVector (NetStat) escribe el vector directamente en una ranura de la segunda cola
+ *    3. puntuación: KitNET::train con los primeros trainNum vectores y KitNET::execute con el resto
+ *       (o un MicroBatcher, que mientras la cola está vacía vigila el plazo del lote pendiente)
+ *  Con overload, los paquetes de los flujos descartados no actualizan NetStat ni llegan a la puntuación y los vectores
+ *  descartados no se puntúan, igual que los que el muestreo por flujo (sampler) no elige; en todos los casos no se llama
+ *  a onScore, pero los números de paquete siguen contando todos los paquetes leídos. Los primeros trainNum paquetes
+ *  nunca se descartan.
+ *  Con las etapas solapadas el rendimiento tiende al de la etapa más lenta en lugar de a la suma de las tres.
+ *  Las puntuaciones se entregan a onScore desde el hilo de puntuación
+ */
+class Pipeline {
+public:
+    // Callback de cada vector puntuado: número de paquete, error de reconstrucción y si se ha entrenado
+    typedef std::function<void(long long packet, double score, bool training)> ScoreCallback;
+
+private:
+    // Momento de la decodificación de cada paquete: la latencia del MicroBatcher se mide desde ahí
+    struct PacketSlot {
+        PacketInfo info;
+        MicroBatcher::Clock::time_point decoded;
+    };
+
+    struct VectorSlot {
+        long long packet;
+        std::vector<double> x;
+        bool skip; // Descartado por el muestreo por flujo
+        MicroBatcher::Clock::time_point decoded;
+    };
+
+    FE *fe;
+
+    KitNET *model;
+
+    long long trainNum;
+
+    PipelineConfig config;
+
+    SPSCRing<PacketSlot> packets; // decodificación -> estadísticas
+
+    SPSCRing<VectorSlot> vectors; // estadísticas -> puntuación
+
+    std::atomic<bool> decodeDone, featureDone;
+
+    ScoreCallback onScore;
+
+    StageStats decodeStats, featureStats, scoreStats;
+
+    void decodeStage();
+
+    void featureStage();
+
+    void scoreStage();
+
+public:
+    // Constructor, los parámetros son el extractor, el modelo (ninguno pasa a ser propiedad del canal),
+    // el número de vectores de entrenamiento y la configuración
+    Pipeline(FE *fe, KitNET *model, long long train_num, const PipelineConfig &config = PipelineConfig());
+
+    Pipeline(const Pipeline &) = delete;
+
+    Pipeline &operator=(const Pipeline &) = delete;
+
+    void setScoreCallback(const ScoreCallback &callback) { onScore = callback; }
+
+    // Procesa todo el fichero del extractor y espera a que terminen las tres etapas. Devuelve el número de paquetes
+    long long run();
+
+    const StageStats &getDecodeStats() const { return decodeStats; }
+
+    const StageStats &getFeatureStats() const { return featureStats; }
+
+    const StageStats &getScoreStats() const { return scoreStats; }
+
+    // Una línea por etapa
+    void printStats(FILE *fp = stdout) const;
+};
+
+#endif //KITSUNE_CPP_PIPELINE_H
@@ -0,0 +1,159 @@
+//
+// Inferencia cuantizada en int8 de un KitNET entrenado.
+//
+
+#ifndef KITSUNE_CPP_QUANTIZE_H
+#define KITSUNE_CPP_QUANTIZE_H
+
+#include <vector>
+#include <cstdint>
+#include "kitNET.h"
+
+
+/**
+ *  Capa completamente conectada cuantizada: pesos int8 con una escala por capa.
+ *  Se ejecuta por lotes con las filas en los carriles SIMD: la entrada x es n_in x R (x[i * R + r] es la entrada i de
+ *  la fila r) y la salida n_out x R. Cada fila se cuantiza una vez con la escala calibrada inScale y los productos se
+ *  hacen con la multiplicación-suma por pares de enteros de 16 bits (pmaddwd; vpdpwssd con AVX-VNNI): los pesos int8
+ *  se amplían a int16 al cargarlos y cada carril int32 acumula dos productos exactos.
+ *  La salida se devuelve en float: acc * escala * wScale + bias
+ */
+struct QuantizedDense {
+    int n_in, n_out;
+
+    int pairs; // Pares de entradas, (n_in + 1) / 2
+
+    std::vector<int8_t> W; // n_out x pairs x 2: los dos pesos de cada par de entradas de la salida o
+
+    std::vector<float> bias; // n_out
+
+    float wScale; // Escala de los pesos: max|W| / 127
+
+    float inScale; // Escala de la entrada, calibrada: max|x| / 127
+
+    // Cuantiza una capa Dense; inputRange es el mayor valor absoluto observado en su entrada
+    template<class Activation>
+    QuantizedDense(Dense<Activation> &layer, double inputRange);
+
+    // Calcula la salida antes de la activación de R filas. Variables temporales: xq (pairs x R x 2), wide
+    // (n_out x pairs), acc (n_out x R) y scale (2 x R). Si una fila sale del rango calibrado se usa su propia escala,
+    // así que los valores anómalos no se saturan
+    void forward(const float *x, int R, int16_t *KITSUNE_RESTRICT xq, int32_t *KITSUNE_RESTRICT wide,
+                 int32_t *KITSUNE_RESTRICT acc, float *KITSUNE_RESTRICT scale, float *KITSUNE_RESTRICT y) const;
+
+    // Bytes de parámetros
+    size_t bytes() const { return W.size() * sizeof(int8_t) + bias.size() * sizeof(float); }
+};
+
+
+/**
+ *  Autocodificador cuantizado con la normalización congelada (los valores máximos y mínimos ya no se actualizan)
+ */
+struct QuantizedAE {
+    int v, h;
+
+    std::vector<double> min_v, scale_v; // Normalización congelada: (x - min_v) * scale_v
+
+    QuantizedDense encoder, decoder;
+
+    // inputRange y hiddenRange son los mayores valores absolutos de la entrada normalizada y de la capa oculta
+    QuantizedAE(AE<KitNETActivation> &ae, double inputRange, double hiddenRange);
+
+    size_t bytes() const {
+        return encoder.bytes() + decoder.bytes() + (min_v.size() + scale_v.size()) * sizeof(double);
+    }
+};
+
+
+/**
+ *  Resultado de comparar el modelo cuantizado con el modelo en double sobre una captura
+ */
+struct QuantizationReport {
+    int samples = 0;
+
+    double meanAbsError = 0; // Error absoluto medio entre los RMSE cuantizado y en double
+
+    double maxAbsError = 0; // Error absoluto máximo
+
+    double meanRelError = 0; // Error relativo medio (respecto al RMSE en double)
+
+    double correlation = 0; // Correlación de Pearson entre ambos RMSE
+
+    // Imprime el informe
+    void print(FILE *out = stderr) const;
+};
+
+
+/**
+ *  QuantizedKitNET: modelo de solo inferencia construido a partir de un KitNET entrenado.
+ *
+ *  Cada AE de la capa integrada y el de la capa de salida se convierten a pesos int8 con una escala por capa (Dense);
+ *  las escalas de las entradas se calibran ejecutando el modelo en double, con la normalización congelada,
+ *  sobre una muestra de los vectores de entrenamiento. El modelo original no se modifica.
+ *  execute_batch recorre los vectores en bloques de BlockRows filas capa a capa: normaliza el bloque una vez, y para
+ *  cada autocodificador cuantiza sus entradas, hace los productos enteros y aplica la sigmoide y el RMSE en float
+ *  sobre todo el bloque, así que cada paso se vectoriza a lo largo de las filas aunque los autocodificadores sean
+ *  pequeños. La sigmoide es la de KitNETActivation evaluada en float: el mismo polinomio de fastExp o, con la sigmoide
+ *  exacta, uno de grado 7, exacto con la precisión de float
+ */
+class QuantizedKitNET {
+private:
+    int inputSize;
+
+    std::vector<int> featureIndex; // Índice de la característica de entrada de cada posición visible (mapa aplanado)
+
+    std::vector<int> vOffset; // Inicio de cada autocodificador en featureIndex
+
+    std::vector<double> normMin, normScale; // Normalización congelada de la capa integrada, aplanada como featureIndex
+
+    std::vector<QuantizedAE> ensemble; // Capa integrada
+
+    QuantizedAE *output = nullptr; // Capa de salida
+
+    // Filas de cada bloque de execute_batch
+    static const int BlockRows = 64;
+
+    // Variables temporales de un bloque, todas con las filas como dimensión contigua: entrada normalizada de la capa
+    // integrada, capa oculta, reconstrucción, entrada de la capa de salida, RMSE y escalas de cuantización
+    std::vector<float> sx, sy, sz, so, sr, ss;
+
+    std::vector<int16_t> sq; // Entrada cuantizada
+
+    std::vector<int32_t> sa, sw; // Acumuladores enteros y pesos de la capa en curso ampliados a int16
+
+    // Reconstruye con ae las R filas de x (ae.v x R, ya normalizada) y guarda el RMSE de cada fila en rmse
+    void reconstruct(const QuantizedAE &ae, const float *x, int R, float *rmse);
+
+    // Ejecuta un bloque de como mucho BlockRows filas
+    void executeBlock(const double *X, int rows, double *result);
+
+public:
+    // Construye el modelo cuantizado; X son rows vectores de calibración (rows x model.getInputSize())
+    QuantizedKitNET(KitNET &model, const double *X, int rows);
+
+    ~QuantizedKitNET();
+
+    QuantizedKitNET(const QuantizedKitNET &) = delete;
+
+    QuantizedKitNET &operator=(const QuantizedKitNET &) = delete;
+
+    // Devuelve el error de reconstrucción del vector de instancia x. Es un lote de una fila, más lento que
+    // KitNET::execute: el modelo cuantizado solo compensa por lotes, así que los vectores sueltos deben acumularse y
+    // puntuarse con execute_batch
+    double execute(const double *x);
+
+    // Ejecución por lotes, X: rows x getInputSize(). Es la forma de usar el modelo: varias veces más rápida que el
+    // modelo en double a partir de unas decenas de filas
+    void execute_batch(const double *X, int rows, double *result);
+
+    // Tamaño de los parámetros del modelo en bytes
+    size_t bytes() const;
+
+    int getInputSize() const { return inputSize; }
+
+    // Compara este modelo con el modelo en double (normalización congelada, sin modificarlo) sobre rows vectores de X
+    QuantizationReport compare(KitNET &model, const double *X, int rows);
+};
+
+
+#endif //KITSUNE_CPP_QUANTIZE_H
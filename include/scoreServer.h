@@ -0,0 +1,212 @@
+//
+// Servicio local de puntuación sobre un socket de dominio Unix, con peticiones por lotes.
+//
+
+#ifndef KITSUNE_CPP_SCORESERVER_H
+#define KITSUNE_CPP_SCORESERVER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "kitNET.h"
+#include "netStat.h"
+#include "featureExtractor.h"
+
+
+/**
+ *  Protocolo binario (orden de bytes de la máquina, el socket es local): cada mensaje es una cabecera ScoreFrame de
+ *  16 bytes seguida de length bytes de contenido. La respuesta repite el id de la petición.
+ *    ScoreVectors  -> ScoreResult: count vectores de instancia (count x getInputSize() double) -> count double
+ *    ScorePackets  -> ScoreResult: count registros de paquete que pasan por el NetStat del servidor -> count double.
+ *                     Cada registro es tiempo y tamaño (double) y srcMAC, dstMAC, srcIP, srcPort, dstIP, dstPort, cada
+ *                     uno como un byte de longitud y sus caracteres (como mucho 255)
+ *    ScoreInfo     -> ScoreInfoReply: sin contenido -> un uint32_t con el tamaño de los vectores de instancia
+ *    cualquier error de una petición -> ScoreError con el mensaje en texto
+ *  Cada petición lleva como mucho ScoreServer::MaxRows vectores o paquetes; ScoreClient divide las más grandes.
+ *  Un cliente puede cerrar su lado de escritura (shutdown) después de enviar: recibe todas las respuestas pendientes
+ *  antes de que el servidor cierre la conexión
+ */
+enum ScoreFrameType : uint16_t {
+    ScoreVectors = 1, ScorePackets = 2, ScoreInfo = 3, ScoreResult = 101, ScoreInfoReply = 102, ScoreError = 199
+};
+
+struct ScoreFrame {
+    uint32_t length; // Bytes de contenido después de la cabecera
+
+    uint16_t type;
+
+    uint16_t flags; // Reservado, 0
+
+    uint32_t id; // Identificador de la petición, libre para el cliente
+
+    uint32_t count; // Vectores, paquetes o puntuaciones
+};
+
+// Codificación de un registro de paquete de ScorePackets
+void encodePacketRecord(const PacketInfo &info, std::string &out);
+
+// Decodifica un registro de paquete que empieza en p (sin pasar de end) y avanza p. Falso si el registro está cortado
+bool decodePacketRecord(const char *&p, const char *end, PacketInfo &info);
+
+
+/**
+ *  ScoreServer: demonio que carga un modelo y atiende peticiones de puntuación de muchos clientes a la vez.
+ *
+ *  Un único hilo con un bucle epoll (solo Linux) acepta conexiones, lee sin bloquear y separa los mensajes completos.
+ *  Todos los vectores de las peticiones leídas en una misma vuelta del bucle, de todos los clientes, se puntúan con una
+ *  sola llamada a KitNET::execute_batch y las respuestas se escriben sin bloquear; un cliente que no lee sus respuestas
+ *  deja de leerse hasta que vacía su búfer de salida. Cada cliente recibe las respuestas en el orden de sus peticiones.
+ *  Las peticiones de paquetes pasan por un NetStat del servidor (ventanas por defecto) compartido por todos los
+ *  clientes, así que sus flujos se mezclan como en una captura
+ */
+class ScoreServer {
+private:
+    struct Connection {
+        int fd;
+
+        std::vector<char> in; // Bytes recibidos sin procesar desde inPos
+
+        size_t inPos = 0;
+
+        std::string out; // Bytes pendientes de enviar desde outPos
+
+        size_t outPos = 0;
+
+        unsigned events = 0; // Eventos registrados en epoll
+
+        bool closed = false;
+
+        bool readClosed = false; // El cliente ha cerrado su lado de escritura: se cierra al enviar las respuestas
+    };
+
+    // Respuesta pendiente de la vuelta actual, en el orden de las peticiones: las puntuaciones son las filas del lote
+    // [row, row + count) y el resto de respuestas llevan su contenido
+    struct Pending {
+        Connection *conn;
+
+        uint32_t id;
+
+        size_t row, count;
+
+        uint16_t type;
+
+        std::string payload;
+    };
+
+    KitNET *model;
+
+    std::string path;
+
+    int n; // Tamaño de los vectores de instancia
+
+    NetStat *netStat = nullptr; // Solo si el modelo usa vectores de NetStat por defecto
+
+    int epollFd = -1, listenFd = -1, stopFd = -1;
+
+    std::unordered_map<int, Connection *> connections;
+
+    std::vector<Pending> pending;
+
+    std::vector<double> X, scores; // Lote de la vuelta actual
+
+    long long requests = 0, rows = 0, batches = 0, accepted = 0, errors = 0;
+
+    // Primera fila libre del lote de la vuelta
+    size_t nextRow() const { return pending.empty() ? 0 : pending.back().row + pending.back().count; }
+
+    void acceptAll();
+
+    // Lee lo disponible y separa los mensajes completos; falso si hay que cerrar la conexión
+    bool readFrom(Connection *conn);
+
+    // Procesa un mensaje completo; falso si hay que cerrar la conexión
+    bool handle(Connection *conn, const ScoreFrame &frame, const char *payload);
+
+    // Puntúa el lote de la vuelta y reparte las respuestas
+    void scoreBatch();
+
+    // Escribe lo que admita el socket; falso si hay que cerrar la conexión
+    bool writeTo(Connection *conn);
+
+    void reply(Connection *conn, uint16_t type, uint32_t id, uint32_t count, const void *payload, size_t length);
+
+    // Ajusta los eventos de epoll según los búferes de la conexión
+    void watch(Connection *conn);
+
+    void close(Connection *conn);
+
+public:
+    static const uint32_t MaxFrame = 64u << 20; // Tamaño máximo del contenido de un mensaje
+
+    static const size_t MaxOutput = 16u << 20; // Salida pendiente a partir de la cual se deja de leer a un cliente
+
+    // Vectores o paquetes por petición: limita el lote que un mensaje de MaxFrame bytes de paquetes (unos 40 bytes
+    // cada uno) puede generar a MaxRows x getInputSize() double
+    static const uint32_t MaxRows = 16384;
+
+    // Constructor, los parámetros son el modelo (no pasa a ser propiedad del servidor) y la ruta del socket
+    ScoreServer(KitNET *model, const std::string &path);
+
+    // Cierra las conexiones y borra el socket
+    ~ScoreServer();
+
+    ScoreServer(const ScoreServer &) = delete;
+
+    ScoreServer &operator=(const ScoreServer &) = delete;
+
+    // Crea el socket (borrando uno anterior en la misma ruta) y atiende peticiones hasta que se llama a stop
+    void run();
+
+    // Detiene run desde otro hilo o desde un manejador de señales (solo escribe en un eventfd)
+    void stop();
+
+    long long getRequests() const { return requests; }
+
+    long long getRows() const { return rows; }
+
+    long long getBatches() const { return batches; }
+
+    long long getAccepted() const { return accepted; }
+
+    long long getErrors() const { return errors; }
+};
+
+
+/**
+ *  ScoreClient: cliente bloqueante del servicio, una petición cada vez
+ */
+class ScoreClient {
+private:
+    int fd = -1;
+
+    uint32_t nextId = 0;
+
+    std::string frame; // Búfer de envío
+
+    std::vector<char> payload; // Contenido de la última respuesta
+
+    // Envía una petición y espera su respuesta, que deja en payload
+    ScoreFrame request(uint16_t type, uint32_t count, const void *data, size_t length);
+
+public:
+    // Se conecta al socket path
+    explicit ScoreClient(const std::string &path);
+
+    ~ScoreClient();
+
+    ScoreClient(const ScoreClient &) = delete;
+
+    ScoreClient &operator=(const ScoreClient &) = delete;
+
+    // Tamaño de los vectores de instancia del modelo del servidor
+    int vectorSize();
+
+    // Puntúa rows vectores contiguos de tamaño n (X: rows x n), en peticiones de como mucho ScoreServer::MaxRows
+    void scoreVectors(const double *X, int rows, int n, double *result);
+
+    // Puntúa paquetes con el NetStat del servidor, en peticiones de como mucho ScoreServer::MaxRows
+    void scorePackets(const std::vector<PacketInfo> &packets, double *result);
+};
+
+#endif //KITSUNE_CPP_SCORESERVER_H
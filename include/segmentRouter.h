@@ -0,0 +1,186 @@
+//
+// Enrutado de los vectores de instancia a un modelo KitNET por segmento de red.
+//
+
+#ifndef KITSUNE_CPP_SEGMENTROUTER_H
+#define KITSUNE_CPP_SEGMENTROUTER_H
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include "kitNET.h"
+#include "featureExtractor.h"
+#include "spscRing.h"
+
+
+/**
+ *  PrefixTable: tabla de prefijos IPv4 con búsqueda del prefijo más largo.
+ *
+ *  Los prefijos se añaden con add y compile los convierte en un trie de paso 8 (nodos de 256 entradas, como mucho
+ *  4 niveles) con los destinos empujados a las hojas, así que lookup son como mucho 4 accesos indexados sin comparaciones
+ */
+class PrefixTable {
+private:
+    struct Prefix {
+        uint32_t address;
+        int length;
+        int target;
+    };
+
+    // Entrada de un nodo: destino del prefijo más largo que la cubre y nodo hijo (-1 si no tiene)
+    struct Entry {
+        int target;
+        int child;
+    };
+
+    std::vector<Prefix> prefixes;
+
+    std::vector<Entry> nodes; // Nodos consecutivos de 256 entradas, el nodo 0 es la raíz
+
+    int defaultTarget = -1; // Destino sin coincidencias
+
+public:
+    // Añade un prefijo en notación CIDR ("10.1.0.0/16"; sin longitud es una dirección /32)
+    void add(const std::string &cidr, int target);
+
+    // Destino de las direcciones que no coinciden con ningún prefijo (-1 = ninguno)
+    void setDefault(int target) { defaultTarget = target; }
+
+    // Construye el trie; debe llamarse después del último add y antes de lookup
+    void compile();
+
+    // Destino del prefijo más largo que contiene address, o el destino por defecto
+    int lookup(uint32_t address) const {
+        const Entry *node = nodes.data();
+        for (int shift = 24;; shift -= 8) {
+            const Entry &e = node[(address >> shift) & 0xff];
+            if (e.child < 0)return e.target;
+            node = nodes.data() + (size_t) e.child * 256;
+        }
+    }
+
+    // Igual con una dirección en texto; las que no son IPv4 (IPv6, MAC) van al destino por defecto
+    int lookup(const std::string &address) const;
+
+    // Convierte una dirección IPv4 en texto, falso si no lo es
+    static bool parseIPv4(const char *text, uint32_t &address);
+};
+
+
+// Clave de enrutado de cada paquete
+enum RouteKey {
+    RouteBySource, RouteByDestination
+};
+
+
+/**
+ *  SegmentRouter: reparte los vectores de un único extractor de características (un solo NetStat) entre varios KitNET,
+ *  uno por segmento de red, elegido por el prefijo más largo de la IP de origen o de destino.
+ *
+ *  Cada segmento tiene su propio hilo y una cola SPSC: dispatch (llamado siempre desde el mismo hilo, el del extractor)
+ *  copia el vector en la cola del segmento y el hilo del segmento entrena su modelo con los primeros trainNum vectores
+ *  que recibe y ejecuta el resto. Si la cola está llena dispatch espera, no se descarta ningún paquete.
+ *  Las puntuaciones se entregan a onScore desde el hilo del segmento, así que el callback no debe compartir estado
+ *  entre segmentos sin sincronizarlo
+ */
+class SegmentRouter {
+public:
+    // Callback de cada vector procesado: segmento, número de paquete, error de reconstrucción y si se ha entrenado
+    typedef std::function<void(int segment, long long packet, double score, bool training)> ScoreCallback;
+
+private:
+    struct Job {
+        long long packet;
+        std::vector<double> x;
+    };
+
+    struct Segment {
+        KitNET *model;
+
+        long long trainNum;
+
+        SPSCRing<Job> queue;
+
+        std::thread worker;
+
+        std::atomic<long long> processed;
+
+        Segment(KitNET *model, long long trainNum, size_t capacity, int vectorSize)
+                : model(model), trainNum(trainNum), queue(capacity, Job{0, std::vector<double>(vectorSize)}),
+                  processed(0) {}
+
+        // La cola tiene miembros alignas(64) y el new de C++11 no respeta alineaciones mayores que la de max_align_t
+        static void *operator new(std::size_t size) {
+            return alignedAlloc((size + sizeof(double) - 1) / sizeof(double));
+        }
+
+        static void operator delete(void *p) { alignedFree(static_cast<double *>(p)); }
+    };
+
+    PrefixTable table;
+
+    RouteKey key;
+
+    int vectorSize;
+
+    size_t queueCapacity;
+
+    std::vector<Segment *> segments;
+
+    ScoreCallback onScore;
+
+    std::atomic<bool> stop;
+
+    bool started = false;
+
+    long long unrouted = 0;
+
+    // Bucle del hilo de un segmento
+    void segmentLoop(int id);
+
+public:
+    // Constructor, los parámetros son la tabla de prefijos (se compila aquí), cuyos destinos son los índices de los
+    // segmentos, la clave de enrutado, el tamaño de los vectores y la capacidad de la cola de cada segmento
+    SegmentRouter(const PrefixTable &table, RouteKey key, int vector_size, size_t queue_capacity = 1024);
+
+    // Espera a que se procesen los vectores pendientes, detiene los hilos y libera los modelos
+    ~SegmentRouter();
+
+    SegmentRouter(const SegmentRouter &) = delete;
+
+    SegmentRouter &operator=(const SegmentRouter &) = delete;
+
+    // Añade un segmento (antes de start) con su modelo, del que pasa a ser propietario, y el número de vectores de
+    // entrenamiento. Devuelve su índice, que es el destino que debe usar la tabla
+    int addSegment(KitNET *model, long long train_num);
+
+    // Callback de las puntuaciones (antes de start)
+    void setScoreCallback(const ScoreCallback &callback) { onScore = callback; }
+
+    // Arranca un hilo por segmento (dispatch lo hace con el primer paquete si no se ha llamado)
+    void start();
+
+    // Segmento del paquete, -1 si no tiene
+    int route(const PacketInfo &info) const {
+        return table.lookup(key == RouteBySource ? info.srcIP : info.dstIP);
+    }
+
+    // Envía el vector x del paquete número packet a su segmento. Devuelve el segmento, o -1 si el paquete no tiene
+    int dispatch(const double *x, const PacketInfo &info, long long packet);
+
+    // Espera a que todos los segmentos hayan procesado lo enviado y detiene los hilos (después ya no se puede usar dispatch)
+    void finish();
+
+    int size() const { return segments.size(); }
+
+    KitNET *getModel(int segment) { return segments[segment]->model; }
+
+    // Vectores procesados por un segmento y paquetes sin segmento
+    long long getProcessed(int segment) const { return segments[segment]->processed.load(); }
+
+    long long getUnrouted() const { return unrouted; }
+};
+
+#endif //KITSUNE_CPP_SEGMENTROUTER_H
@@ -0,0 +1,130 @@
+//
+// Lectura y escritura de ficheros binarios de modelos.
+//
+
+#ifndef KITSUNE_CPP_SERIALIZE_H
+#define KITSUNE_CPP_SERIALIZE_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+
+// Si la máquina es little-endian (el orden de bytes de los ficheros)
+inline bool hostLittleEndian() {
+    const uint32_t one = 1;
+    unsigned char b;
+    std::memcpy(&b, &one, 1);
+    return b == 1;
+}
+
+
+/**
+ *  BinaryWriter: escribe enteros y double en little-endian, sea cual sea el orden de bytes de la máquina.
+ *  align rellena con ceros hasta un múltiplo del tamaño dado, para que los bloques grandes se puedan usar
+ *  directamente desde un fichero proyectado con mmap
+ */
+class BinaryWriter {
+private:
+    FILE *fp;
+
+    size_t offset = 0; // Bytes escritos
+
+public:
+    explicit BinaryWriter(const char *filename);
+
+    ~BinaryWriter();
+
+    BinaryWriter(const BinaryWriter &) = delete;
+
+    BinaryWriter &operator=(const BinaryWriter &) = delete;
+
+    void bytes(const void *data, size_t n);
+
+    void u32(uint32_t v);
+
+    void u64(uint64_t v);
+
+    void f64(double v);
+
+    void f64s(const double *v, size_t n);
+
+    void i32s(const int *v, size_t n);
+
+    void align(size_t alignment);
+
+    size_t tell() const { return offset; }
+};
+
+
+/**
+ *  BinaryReader: lee los valores escritos por BinaryWriter de un bloque de memoria, comprobando los límites
+ */
+class BinaryReader {
+private:
+    const unsigned char *data;
+
+    size_t size;
+
+    size_t offset = 0;
+
+    // Comprueba que quedan n bytes
+    void need(size_t n) const;
+
+public:
+    BinaryReader(const void *data, size_t size) : data((const unsigned char *) data), size(size) {}
+
+    void bytes(void *out, size_t n);
+
+    uint32_t u32();
+
+    uint64_t u64();
+
+    double f64();
+
+    // Lee n double en out (convirtiendo el orden de bytes si hace falta)
+    void f64s(double *out, size_t n);
+
+    void i32s(int *out, size_t n);
+
+    void align(size_t alignment);
+
+    void skip(size_t n);
+
+    size_t tell() const { return offset; }
+
+    // Posición actual dentro del bloque
+    const unsigned char *here() const { return data + offset; }
+};
+
+
+/**
+ *  MappedFile: fichero completo en memoria, modificable sin tocar el fichero.
+ *  En POSIX se proyecta con mmap privado (copia en escritura): las páginas se comparten entre todos los procesos que
+ *  abren el mismo fichero hasta que se escriben, y solo se copian las páginas escritas. En Windows se lee el fichero en
+ *  un bloque alineado
+ */
+class MappedFile {
+private:
+    unsigned char *base = nullptr;
+
+    size_t length = 0;
+
+public:
+    explicit MappedFile(const char *filename);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const unsigned char *data() const { return base; }
+
+    unsigned char *data() { return base; }
+
+    size_t size() const { return length; }
+};
+
+#endif //KITSUNE_CPP_SERIALIZE_H
@@ -0,0 +1,98 @@
+//
+// Cola circular sin bloqueos de un productor y un consumidor.
+//
+
+#ifndef KITSUNE_CPP_SPSCRING_H
+#define KITSUNE_CPP_SPSCRING_H
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+/**
+ *  SPSCRing: cola circular de capacidad fija (potencia de dos) para exactamente un hilo productor y un hilo consumidor.
+ *
+ *  Las ranuras se reservan al construirla y se usan en su sitio: el productor pide una ranura libre con claim,
+ *  la rellena y la publica con publish; el consumidor lee la primera con front y la libera con release.
+ *  Así los elementos grandes (p. ej. vectores de características) no se copian dos veces ni se reserva memoria por elemento.
+ *  Cada lado guarda una copia del índice del otro y solo lee el atómico compartido cuando la cola parece llena o vacía
+ */
+template<class T>
+class SPSCRing {
+private:
+    std::vector<T> slots;
+
+    size_t mask;
+
+    alignas(64) std::atomic<size_t> head; // Siguiente posición a escribir (solo la modifica el productor)
+
+    size_t cachedTail = 0; // Copia de tail del productor
+
+    alignas(64) std::atomic<size_t> tail; // Siguiente posición a leer (solo la modifica el consumidor)
+
+    size_t cachedHead = 0; // Copia de head del consumidor
+
+public:
+    // capacity se redondea a la siguiente potencia de dos; todas las ranuras se inicializan con una copia de init
+    explicit SPSCRing(size_t capacity, const T &init = T()) : head(0), tail(0) {
+        size_t size = 1;
+        while (size < capacity)size <<= 1;
+        slots.assign(size, init);
+        mask = size - 1;
+    }
+
+    SPSCRing(const SPSCRing &) = delete;
+
+    SPSCRing &operator=(const SPSCRing &) = delete;
+
+    size_t capacity() const { return slots.size(); }
+
+    // Número aproximado de elementos (exacto si no hay operaciones concurrentes)
+    size_t size() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+
+    // Productor: ranura libre para el siguiente elemento, o nullptr si la cola está llena
+    T *claim() {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - cachedTail == slots.size()) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (h - cachedTail == slots.size())return nullptr;
+        }
+        return &slots[h & mask];
+    }
+
+    // Productor: publica la ranura obtenida con claim
+    void publish() { head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    // Productor: copia value en la cola, falso si está llena
+    bool push(const T &value) {
+        T *slot = claim();
+        if (slot == nullptr)return false;
+        *slot = value;
+        publish();
+        return true;
+    }
+
+    // Consumidor: primer elemento, o nullptr si la cola está vacía
+    T *front() {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == cachedHead) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (t == cachedHead)return nullptr;
+        }
+        return &slots[t & mask];
+    }
+
+    // Consumidor: libera el elemento obtenido con front
+    void release() { tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    // Consumidor: copia el primer elemento en value, falso si la cola está vacía
+    bool pop(T &value) {
+        T *slot = front();
+        if (slot == nullptr)return false;
+        value = *slot;
+        release();
+        return true;
+    }
+};
+
+#endif //KITSUNE_CPP_SPSCRING_H
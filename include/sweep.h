@@ -0,0 +1,90 @@
+//
+// Barrido de hiperparámetros de KitNET sobre un mismo flujo de vectores de características.
+//
+
+#ifndef KITSUNE_CPP_SWEEP_H
+#define KITSUNE_CPP_SWEEP_H
+
+#include <vector>
+#include <cstdio>
+#include "kitNET.h"
+#include "featureExtractor.h"
+#include "workerPool.h"
+
+
+// Una configuración del barrido: los parámetros de KitNET y el reparto entre entrenamiento y ejecución
+struct SweepConfig {
+    int maxAE = 10; // Tamaño máximo de los autocodificadores de la capa integrada
+
+    int fmTrainNum = 5000; // Muestras de la fase de mapeo de características
+
+    int adTrainNum = 50000; // Muestras de entrenamiento de los autocodificadores
+
+    double ensembleVhRate = 0.75, outputVhRate = 0.75;
+
+    double ensembleLearningRate = 0.1, outputLearningRate = 0.1;
+};
+
+// Resultado de una configuración
+struct SweepResult {
+    SweepConfig config;
+
+    std::vector<double> rmse; // Error de cada vector, como RMSE.txt (solo si se pide el flujo completo)
+
+    long long executed = 0; // Vectores ejecutados después del entrenamiento
+
+    double meanRMSE = 0, maxRMSE = 0; // Resumen de los errores de la fase de ejecución
+
+    // Tiempo de cálculo de esta configuración (suma de sus bloques): entrenamiento (fase de mapeo incluida) y ejecución
+    double trainSeconds = 0, executeSeconds = 0;
+
+    double throughput = 0; // Vectores ejecutados por segundo de ejecución
+};
+
+
+/**
+ *  SweepEngine: entrena y puntúa una rejilla de configuraciones de KitNET en una sola pasada sobre los datos.
+ *
+ *  Los vectores se extraen una sola vez (loadVectors) y se recorren en bloques de blockRows filas. Para cada bloque
+ *  los hilos del grupo toman configuraciones de una cola compartida y las avanzan sobre el bloque completo
+ *  (train en las primeras fmTrainNum + adTrainNum filas, execute en el resto, igual que testARP),
+ *  así que todas leen el mismo bloque mientras está en caché. Cada modelo solo lo toca un hilo a la vez, y las filas
+ *  de la fase de mapeo, que pueden construir los autocodificadores (pesos iniciales de rand_uniform), se entrenan de
+ *  una configuración en una. El tiempo de entrenamiento y el de ejecución se miden por separado
+ */
+class SweepEngine {
+private:
+    const double *X; // rows x n, no se copia
+
+    long long rows;
+
+    int n;
+
+    int blockRows;
+
+    WorkerPool pool;
+
+public:
+    // Constructor, los parámetros son los vectores (rows x n, deben vivir mientras se use el motor), el número de hilos
+    // (incluido el llamador) y las filas de cada bloque
+    SweepEngine(const double *X, long long rows, int n, int threads, int block_rows = 1024);
+
+    // Ejecuta todas las configuraciones; con keepStreams guarda el error de cada vector en SweepResult::rmse.
+    // Lanza -1 antes de empezar si alguna configuración no es válida
+    std::vector<SweepResult> run(const std::vector<SweepConfig> &grid, bool keepStreams = false);
+
+    // Extrae todos los vectores de características de fe (filas de fe.getVectorSize() valores)
+    static std::vector<double> loadVectors(FE &fe);
+
+    // Producto cartesiano de los valores de cada parámetro
+    static std::vector<SweepConfig> grid(const std::vector<int> &maxAE, const std::vector<int> &fmTrainNum,
+                                         const std::vector<int> &adTrainNum, const std::vector<double> &ensembleVhRate,
+                                         const std::vector<double> &outputVhRate,
+                                         const std::vector<double> &ensembleLearningRate,
+                                         const std::vector<double> &outputLearningRate);
+
+    // Una línea por configuración: parámetros, resumen y rendimiento
+    static void printSummary(const std::vector<SweepResult> &results, FILE *fp = stdout);
+};
+
+#endif //KITSUNE_CPP_SWEEP_H
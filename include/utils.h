@@ -15,6 +15,20 @@
 #include <cmath>
 #include <ctime>
 #include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#include <cstdint>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// Calificador restrict para los núcleos numéricos (permite al compilador vectorizar sin comprobar solapamientos)
+#if defined(_MSC_VER)
+#define KITSUNE_RESTRICT __restrict
+#else
+#define KITSUNE_RESTRICT __restrict__
+#endif
 
 
 // Convierta el archivo pcap a tsv y devuelva el puntero del archivo tsv
@@ -63,6 +77,9 @@ public:
     // Convierta la columna de la columna en una cadena y regrese
     std::string getString(int col);
 
+    // Copia la columna col en out reutilizando su capacidad: sin reservar memoria si ya cabe
+    void getString(int col, std::string &out);
+
     // Convierta la columna col en un int y regrese
     inline int getInt(int col) {
         int ans = 0;
@@ -123,6 +140,39 @@ public:
 };
 
 
+/**
+ *  Memoria alineada para los bloques de pesos contiguos
+ */
+
+// Alineación de los bloques (una línea de caché, suficiente para AVX-512)
+const std::size_t KitsuneAlignment = 64;
+
+// Reserva n doubles alineados a KitsuneAlignment. Se libera con alignedFree
+inline double *alignedAlloc(std::size_t n) {
+    if (n == 0)n = 1;
+    void *p = nullptr;
+#ifdef _WIN32
+    p = _aligned_malloc(n * sizeof(double), KitsuneAlignment);
+#else
+    if (posix_memalign(&p, KitsuneAlignment, n * sizeof(double)) != 0)p = nullptr;
+#endif
+    if (p == nullptr) {
+        std::fprintf(stderr, "alignedAlloc: out of memory\n");
+        throw -1;
+    }
+    return static_cast<double *>(p);
+}
+
+// Libera la memoria reservada con alignedAlloc
+inline void alignedFree(double *p) {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+
 /**
  *  一Serie de funciones de activación comunes
  */
@@ -150,6 +200,127 @@ inline double ELU(double x) {
 }
 
 
+// Polinomio de Taylor de e^r en forma de Horner, 1 + r/N * (1 + r/(N+1) * (...)), expandido en tiempo de compilación
+template<int N, int Degree, bool End = (N > Degree)>
+struct TaylorExp {
+    static double eval(double r) { return 1.0 + r * (1.0 / N) * TaylorExp<N + 1, Degree>::eval(r); }
+};
+
+template<int N, int Degree>
+struct TaylorExp<N, Degree, true> {
+    static double eval(double) { return 1.0; }
+};
+
+/**
+ *  Exponencial aproximada sin saltos ni llamadas, vectorizable.
+ *  exp(x) = 2^k * 2^f con k = round(x * log2(e)) y |f| <= 0,5; 2^f se evalúa con el polinomio de Taylor de grado Degree
+ *  y 2^k se construye directamente en los bits del exponente. Error relativo aproximado: grado 5 ~ 3e-6, 9 ~ 1e-11, 13 ~ 6e-15
+ */
+
+// Versión sin comprobación de rango, válida para |x| <= 700. Sin comparaciones para que el bucle que la llama se vectorice
+template<int Degree>
+inline double fastExpUnchecked(double x) {
+    const double log2e = 1.4426950408889634, ln2 = 0.6931471805599453;
+    double t = x * log2e;
+    // Redondeo al entero más cercano con el número mágico 1.5 * 2^52; los bits bajos de kd contienen k
+    const double magic = 6755399441055744.0;
+    double kd = t + magic;
+    double k = kd - magic;
+    double p = TaylorExp<1, Degree>::eval((t - k) * ln2);
+    std::uint64_t bits;
+    std::memcpy(&bits, &kd, sizeof(bits));
+    bits = (bits - 0x4338000000000000ULL + 1023) << 52;
+    double scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return p * scale;
+}
+
+// Satura x al rango válido de fastExpUnchecked
+inline double fastExpClamp(double x) {
+    return x < -700 ? -700 : (x > 700 ? 700 : x);
+}
+
+template<int Degree>
+inline double fastExp(double x) {
+    return fastExpUnchecked<Degree>(fastExpClamp(x));
+}
+
+
+/**
+ *  Políticas de activación para Dense y AE, elegidas en tiempo de compilación para que el compilador pueda
+ *  expandir y vectorizar la pasada de activación. f es la función, df su derivada expresada con el valor fx = f(x)
+ *  y apply aplica f a n valores en su sitio
+ */
+
+struct SigmoidActivation {
+    static double f(double x) { return sigmoid(x); }
+
+    static double df(double fx) { return sigmoidDerivative(fx); }
+
+    static void apply(double *v, int n) { for (int i = 0; i < n; ++i)v[i] = f(v[i]); }
+};
+
+// Precisión de la sigmoide aproximada: grado del polinomio de fastExp
+enum SigmoidAccuracy {
+    SigmoidLow = 5, SigmoidMedium = 9, SigmoidHigh = 13
+};
+
+// Sigmoide con fastExp, sin llamadas a std::exp
+template<int Accuracy>
+struct FastSigmoidActivation {
+    static double f(double x) { return 1.0 / (1.0 + fastExp<Accuracy>(-x)); }
+
+    static double df(double fx) { return sigmoidDerivative(fx); }
+
+    // La saturación va en una pasada aparte para que las dos pasadas se vectoricen
+    static void apply(double *v, int n) {
+        for (int i = 0; i < n; ++i)v[i] = fastExpClamp(v[i]);
+        for (int i = 0; i < n; ++i)v[i] = 1.0 / (1.0 + fastExpUnchecked<Accuracy>(-v[i]));
+    }
+};
+
+struct IdentityActivation {
+    static double f(double x) { return x; }
+
+    static double df(double) { return 1; }
+
+    static void apply(double *, int) {}
+};
+
+struct ReLUActivation {
+    static double f(double x) { return ReLU(x); }
+
+    static double df(double fx) { return fx > 0 ? 1 : 0; }
+
+    static void apply(double *v, int n) { for (int i = 0; i < n; ++i)v[i] = f(v[i]); }
+};
+
+struct PReLUActivation {
+    static double f(double x) { return pReLU(x); }
+
+    // f(x) < 0 exactamente cuando x < 0
+    static double df(double fx) { return fx < 0 ? 0.01 : 1; }
+
+    static void apply(double *v, int n) { for (int i = 0; i < n; ++i)v[i] = f(v[i]); }
+};
+
+struct ELUActivation {
+    static double f(double x) { return ELU(x); }
+
+    // Para x < 0, f'(x) = alpha * e^x = f(x) + alpha
+    static double df(double fx) { return fx < 0 ? fx + 0.01 : 1; }
+
+    static void apply(double *v, int n) { for (int i = 0; i < n; ++i)v[i] = f(v[i]); }
+};
+
+// Activación de los autocodificadores de KitNET. Por defecto la sigmoide exacta; compilando con
+// KITSUNE_FAST_SIGMOID=<SigmoidLow|SigmoidMedium|SigmoidHigh> se usa la aproximación vectorizable
+#ifdef KITSUNE_FAST_SIGMOID
+typedef FastSigmoidActivation<KITSUNE_FAST_SIGMOID> KitNETActivation;
+#else
+typedef SigmoidActivation KitNETActivation;
+#endif
+
 /**
  * 一Índice de evaluación de regresión
  */
@@ -192,11 +363,10 @@ inline double MAE(const double *a, const double *b, int n) {
 
 // Distribuidos equitativamente
 inline double rand_uniform(double _min, double _max) {
-    static bool seed = false;
-    if(!seed){// Establecer la semilla de número aleatorio una vez
-        std::srand(std::time(NULL));
-        seed = true;
-    }
+    // Establecer la semilla de número aleatorio una vez (la inicialización de una variable estática local es segura
+    // entre hilos)
+    static bool seed = (std::srand(std::time(NULL)), true);
+    (void) seed;
     return rand() / (RAND_MAX + 0.1) * (_max - _min) + _min;
 }
 
@@ -0,0 +1,63 @@
+//
+// Grupo de hilos persistente con bifurcación/unión de baja latencia.
+//
+
+#ifndef KITSUNE_CPP_WORKERPOOL_H
+#define KITSUNE_CPP_WORKERPOOL_H
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+/**
+ *  WorkerPool: hilos creados una sola vez que ejecutan la misma tarea en paralelo (fork/join).
+ *
+ *  run publica la tarea incrementando un contador de generación; los hilos esperan primero de forma activa
+ *  (spin) durante un número configurable de iteraciones y después se duermen en una variable de condición,
+ *  así que con paquetes seguidos la bifurcación no pasa por el sistema operativo y con el grupo inactivo no consume CPU.
+ *  El hilo que llama a run participa como el trabajador 0.
+ */
+class WorkerPool {
+private:
+    std::vector<std::thread> workers;
+
+    // Tarea actual, válida mientras dura run
+    const std::function<void(int)> *job = nullptr;
+
+    std::atomic<unsigned> generation; // Se incrementa con cada tarea publicada
+
+    std::atomic<int> pending; // Trabajadores que todavía no han terminado la tarea actual
+
+    std::atomic<int> sleepers; // Trabajadores dormidos en la variable de condición
+
+    std::atomic<bool> stop;
+
+    std::mutex mutex;
+
+    std::condition_variable wake;
+
+    int spinCount; // Iteraciones de espera activa antes de dormir
+
+    // Bucle de cada trabajador
+    void workerLoop(int id);
+
+public:
+    // Constructor, los parámetros son el número total de hilos (incluido el que llama a run) y las iteraciones de espera activa
+    explicit WorkerPool(int threads, int spin = 20000);
+
+    ~WorkerPool();
+
+    // Número de hilos, incluido el llamador
+    int size() const { return workers.size() + 1; }
+
+    // Ejecuta job(id) con id = 0 .. size() - 1, cada uno en un hilo, y espera a que terminen todos
+    void run(const std::function<void(int)> &job);
+
+    // Pausa breve dentro de una espera activa
+    static void relax();
+};
+
+#endif //KITSUNE_CPP_WORKERPOOL_H
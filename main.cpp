@@ -1,8 +1,17 @@
 #include <iostream>
 #include <ctime>
 #include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <thread>
+#include <chrono>
+#include <algorithm>
 #include "include/kitNET.h"
 #include "include/featureExtractor.h"
+#include "include/sweep.h"
+#include "include/segmentRouter.h"
+#include "include/pipeline.h"
+#include "include/scoreServer.h"
 #include "test/test.h"
 
 using namespace std;
@@ -85,7 +94,9 @@ void aE() {
     delete kitNET;
 }
 
-void testARP() {
+// loadModel: modelo guardado que se carga en lugar de entrenar; saveModel: dónde guardar el modelo al terminar el
+// entrenamiento. nullptr desactiva cada uno
+void testARP(const char *loadModel = nullptr, const char *saveModel = nullptr) {
     const char *filename = "F:\\Dataset\\KITSUNE\\Mirai\\ejer3.pcap"; //archivo con captura de Datos
     const int FM_train_num = 10000; // La cantidad de mapas de características de entrenamiento requeridos
     const int AD_train_num = 300000; // El número de módulos de detección de anomalías de formación necesarios
@@ -96,7 +107,11 @@ void testARP() {
 
     int sz = fe->getVectorSize(); // Obtenga el número requerido para la extracción de características
 
-    auto kitNET = new KitNET(sz, max_AE, FM_train_num); // Inicializar el módulo kitNET
+    // Inicializar el módulo kitNET, o cargar el modelo indicado
+    bool trained = loadModel != nullptr;
+    auto kitNET = trained ? KitNET::load(loadModel) : new KitNET(sz, max_AE, FM_train_num);
+    // La fase de mapeo termina en cuanto el mapa deja de cambiar (FM_train_num es el máximo)
+    if (!trained)kitNET->setAdaptiveFeatureMap(1000);
 
     auto *x = new double[sz]; // Inicializar el búfer almacenando el vector de características de entrada
 
@@ -104,9 +119,10 @@ void testARP() {
     int now_packet = 0;
     while (fe->nextVector(x)) {
         ++now_packet;
-        if (now_packet <= KitNET_train_num)
+        if (!trained && now_packet <= KitNET_train_num) {
             fprintf(fp, "%.15f\n", kitNET->train(x));
-        else
+            if (now_packet == KitNET_train_num && saveModel != nullptr)kitNET->save(saveModel);
+        } else
             fprintf(fp, "%.15f\n", kitNET->execute(x));
 
         if (now_packet % 1000 == 0)printf("%d\n", now_packet);
@@ -120,13 +136,190 @@ void testARP() {
 }
 
 
-int main() {
+// Igual que testARP pero con la decodificación, NetStat y KitNET en tres hilos fijados a CPU distintas
+void testPipeline() {
+    const char *filename = "F:\\Dataset\\KITSUNE\\Mirai\\ejer3.pcap"; //archivo con captura de Datos
+    const int FM_train_num = 10000; // La cantidad de mapas de características de entrenamiento requeridos
+    const int AD_train_num = 300000; // El número de módulos de detección de anomalías de formación necesarios
+    const int KitNET_train_num = AD_train_num + FM_train_num;  // El número necesario para entrenar KitNET
+    const int max_AE = 10; // La mayor escala de codificador automático
+
+    auto fe = new FE(filename, PCAP);  // Inicializar el módulo de extracción de características
+    auto kitNET = new KitNET(fe->getVectorSize(), max_AE, FM_train_num); // Inicializar el módulo kitNET
+
+    PipelineConfig config;
+    config.decodeCpu = 0;
+    config.featureCpu = 1;
+    config.scoreCpu = 2;
+    Pipeline pipeline(fe, kitNET, KitNET_train_num, config);
+    FILE *fp = fopen("RMSE.txt", "w");
+    pipeline.setScoreCallback([&](long long packet, double score, bool) {
+        fprintf(fp, "%.15f\n", score);
+        if ((packet + 1) % 1000 == 0)printf("%lld\n", packet + 1);
+    });
+    long long total = pipeline.run();
+
+    printf("total packets is %lld\n", total);
+    pipeline.printStats();
+    fclose(fp);
+    delete kitNET;
+    delete fe;
+}
+
+// Un KitNET por segmento de red, todos alimentados por el mismo extractor de características
+void testSegments() {
+    const char *filename = "F:\\Dataset\\KITSUNE\\Mirai\\ejer3.pcap"; //archivo con captura de Datos
+    const int FM_train_num = 5000; // Muestras de la fase de mapeo de cada segmento
+    const int AD_train_num = 50000; // Muestras de entrenamiento de los autocodificadores de cada segmento
+    const int max_AE = 10; // La mayor escala de codificador automático
+
+    auto fe = new FE(filename, PCAP);  // Inicializar el módulo de extracción de características
+    int sz = fe->getVectorSize();
+
+    // Segmentos por prefijo de la IP de origen; el resto del tráfico va al último
+    PrefixTable table;
+    table.add("192.168.0.0/16", 0);
+    table.add("10.0.0.0/8", 1);
+    table.setDefault(2);
+    SegmentRouter router(table, RouteBySource, sz);
+    vector<FILE *> files;
+    for (int s = 0; s < 3; ++s) {
+        router.addSegment(new KitNET(sz, max_AE, FM_train_num), FM_train_num + AD_train_num);
+        files.push_back(fopen(("RMSE_segment" + to_string(s) + ".txt").c_str(), "w"));
+    }
+    // Cada fichero solo lo escribe el hilo de su segmento
+    router.setScoreCallback([&](int segment, long long packet, double score, bool) {
+        fprintf(files[segment], "%lld,%.15f\n", packet, score);
+    });
+
+    auto *x = new double[sz];
+    PacketInfo info;
+    long long now_packet = 0;
+    while (fe->nextPacket(x, info)) {
+        router.dispatch(x, info, now_packet++);
+        if (now_packet % 1000 == 0)printf("%lld\n", now_packet);
+    }
+    router.finish();
+
+    printf("total packets is %lld\n", now_packet);
+    for (int s = 0; s < router.size(); ++s)printf("segment %d: %lld packets\n", s, router.getProcessed(s));
+    for (FILE *fp : files)fclose(fp);
+    delete[] x;
+    delete fe;
+}
+
+// Barrido de hiperparámetros: los vectores se extraen una vez y todas las configuraciones se evalúan en la misma pasada
+void sweep() {
+    const char *filename = "F:\\Dataset\\KITSUNE\\Mirai\\feature_my.csv";
+    const int threads = 4; // Hilos del barrido, incluido el principal
+
+    auto fe = new FE(filename, FeatureCSV);  // Inicializar el módulo de extracción de características
+    int sz = fe->getVectorSize();
+    vector<double> X = SweepEngine::loadVectors(*fe);
+    delete fe;
+
+    vector<SweepConfig> grid = SweepEngine::grid({5, 10}, {5000}, {50000}, {0.5, 0.75}, {0.75}, {0.05, 0.1}, {0.1});
+    SweepEngine engine(X.data(), X.size() / sz, sz, threads);
+    vector<SweepResult> results = engine.run(grid);
+
+    FILE *fp = fopen("sweep.csv", "w");
+    SweepEngine::printSummary(results, fp);
+    fclose(fp);
+    SweepEngine::printSummary(results);
+}
+
+static ScoreServer *server = nullptr;
+
+static void stopServer(int) {
+    if (server != nullptr)server->stop();
+}
+
+// Modo demonio: carga un modelo guardado con KitNET::save y atiende peticiones de puntuación en un socket Unix
+int serve(const char *model_file, const char *socket_path) {
+    KitNET *kitNET = KitNET::load(model_file);
+    server = new ScoreServer(kitNET, socket_path);
+    signal(SIGINT, stopServer);
+    signal(SIGTERM, stopServer);
+    printf("serving %s on %s\n", model_file, socket_path);
+    server->run();
+    printf("%lld clients, %lld requests, %lld vectors in %lld batches, %lld errors\n", server->getAccepted(),
+           server->getRequests(), server->getRows(), server->getBatches(), server->getErrors());
+    delete server;
+    server = nullptr;
+    delete kitNET;
+    return 0;
+}
+
+// Generador de carga del modo demonio: clients clientes concurrentes, cada uno con requests peticiones de batch vectores
+int loadgen(const char *socket_path, int clients, int requests, int batch) {
+    if (clients <= 0 || requests <= 0 || batch <= 0) {
+        fprintf(stderr, "loadgen: clients, requests and batch must be positive\n");
+        return 1;
+    }
+    int n = ScoreClient(socket_path).vectorSize();
+    if ((size_t) batch * n * sizeof(double) > ScoreServer::MaxFrame) {
+        fprintf(stderr, "loadgen: a batch of %d vectors exceeds the server frame limit\n", batch);
+        return 1;
+    }
+    rand_uniform(0, 1); // Siembra antes de crear los hilos, que luego solo llaman a rand
+    vector<vector<double> > latencies(clients);
+    auto t0 = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (int c = 0; c < clients; ++c)
+        threads.emplace_back([&, c]() {
+            ScoreClient client(socket_path);
+            vector<double> X((size_t) batch * n), scores(batch);
+            for (double &v : X)v = rand_uniform(0, 1);
+            for (int r = 0; r < requests; ++r) {
+                auto start = chrono::steady_clock::now();
+                client.scoreVectors(X.data(), batch, n, scores.data());
+                latencies[c].push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - start).count());
+            }
+        });
+    for (thread &t : threads)t.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+
+    vector<double> all;
+    for (auto &l : latencies)all.insert(all.end(), l.begin(), l.end());
+    sort(all.begin(), all.end());
+    printf("%d clients x %d requests x %d vectors: %.0f vectors/s, request latency p50 %.1f us p99 %.1f us\n",
+           clients, requests, batch, (double) all.size() * batch / seconds, all[all.size() / 2],
+           all[all.size() * 99 / 100]);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    // Kitsune_cpp serve <modelo> <socket>
+    if (argc == 4 && strcmp(argv[1], "serve") == 0)return serve(argv[2], argv[3]);
+    // Kitsune_cpp loadgen <socket> [clientes] [peticiones] [vectores por petición]
+    if (argc >= 3 && strcmp(argv[1], "loadgen") == 0)
+        return loadgen(argv[2], argc > 3 ? atoi(argv[3]) : 8, argc > 4 ? atoi(argv[4]) : 1000,
+                       argc > 5 ? atoi(argv[5]) : 16);
+
+    // Kitsune_cpp [--load <modelo>] [--save <modelo>]: testARP carga el modelo en lugar de entrenar o lo guarda
+    // después del entrenamiento
+    const char *loadModel = nullptr, *saveModel = nullptr;
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 < argc && strcmp(argv[i], "--load") == 0)loadModel = argv[i + 1];
+        else if (i + 1 < argc && strcmp(argv[i], "--save") == 0)saveModel = argv[i + 1];
+        else {
+            fprintf(stderr, "KitNET: unknown option or missing value: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
     time_t start_time = time(nullptr);
     
    
+    // Comprobaciones: el programa termina con error si alguna falla
+    if (testParallelTrain() != 0 || testMicroBatch() != 0)return 1;
+
     //kitsuneExample();
-    testARP();
+    testARP(loadModel, saveModel);
     //aE();
+    //sweep();
+    //testSegments();
+    //testPipeline();
     testDense();
 
 
@@ -0,0 +1,18 @@
+//
+// Núcleos especializados por tamaño para los pequeños autocodificadores de KitNET.
+//
+
+#include "../include/aeKernels.h"
+
+
+DenseKernel selectDenseKernel(int n_in, int n_out) {
+    if (n_in < 1 || n_out < 1 || n_in > KITSUNE_AE_KERNEL_MAX || n_out > KITSUNE_AE_KERNEL_MAX)return nullptr;
+    // Tabla construida una sola vez, la primera vez que se consulta
+    struct Table {
+        DenseKernel kernels[KITSUNE_AE_KERNEL_MAX * KITSUNE_AE_KERNEL_MAX + 1];
+
+        Table() { DenseKernelTable<KITSUNE_AE_KERNEL_MAX, KITSUNE_AE_KERNEL_MAX>::fill(kernels); }
+    };
+    static const Table table;
+    return table.kernels[(n_in - 1) * KITSUNE_AE_KERNEL_MAX + n_out - 1];
+}
@@ -0,0 +1,81 @@
+//
+// Entrenamiento continuo en segundo plano con publicación de instantáneas congeladas.
+//
+
+#include <algorithm>
+#include <chrono>
+#include "../include/backgroundTrainer.h"
+
+
+BackgroundTrainer::BackgroundTrainer(KitNET *model, long long publish_interval, size_t queue_capacity)
+        : shadow(model), inputSize(model->getInputSize()), publishInterval(publish_interval),
+          queue(queue_capacity, std::vector<double>(model->getInputSize())), version(0), trained(0), dropped(0),
+          stop(false) {
+    if (publish_interval < 1) {
+        fprintf(stderr, "KitNET: the publish interval must be positive\n");
+        throw -1;
+    }
+    if (shadow->isInitialized())publish();
+    worker = std::thread(&BackgroundTrainer::trainLoop, this);
+}
+
+BackgroundTrainer::~BackgroundTrainer() {
+    stop.store(true);
+    worker.join();
+    delete shadow;
+}
+
+void BackgroundTrainer::publish() {
+    std::shared_ptr<FrozenKitNET> snapshot(shadow->freeze());
+    std::atomic_store(&published, snapshot);
+    version.fetch_add(1, std::memory_order_release);
+}
+
+void BackgroundTrainer::trainLoop() {
+    long long sinceSnapshot = 0;
+    int idle = 0;
+    while (!stop.load(std::memory_order_relaxed)) {
+        std::vector<double> *x = queue.front();
+        if (x == nullptr) {
+            // Cola vacía: espera activa breve y después se duerme para no competir con el camino caliente
+            if (++idle < 1000)WorkerPool::relax();
+            else std::this_thread::sleep_for(std::chrono::microseconds(100));
+            continue;
+        }
+        idle = 0;
+        shadow->train(x->data());
+        queue.release();
+        trained.fetch_add(1, std::memory_order_release);
+        // Las muestras de la fase de mapeo no cuentan para el intervalo
+        if (shadow->isInitialized() && ++sinceSnapshot >= publishInterval) {
+            publish();
+            sinceSnapshot = 0;
+        }
+    }
+}
+
+bool BackgroundTrainer::submit(const double *x) {
+    std::vector<double> *slot = queue.claim();
+    if (slot == nullptr) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    std::copy(x, x + inputSize, slot->begin());
+    queue.publish();
+    return true;
+}
+
+double BackgroundTrainer::execute(const double *x) {
+    // Solo se toca el puntero compartido cuando hay una publicación nueva
+    unsigned v = version.load(std::memory_order_acquire);
+    if (v != currentVersion) {
+        current = std::atomic_load(&published);
+        currentVersion = v;
+    }
+    if (!current)return 0;
+    return current->execute(x);
+}
+
+void BackgroundTrainer::drain() {
+    while (queue.size() != 0)std::this_thread::sleep_for(std::chrono::microseconds(100));
+}
@@ -3,116 +3,279 @@
 //
 
 #include "../include/cluster.h"
+#include "../include/serialize.h"
+
+const int Cluster::BatchRows;
 
 Cluster::Cluster(int size) {
     n = size;
-    sum = new double[n];
-    sum1 = new double[n];
-    sum2 = new double[n];
     num = 0;
-    C = new double *[n];
-    for (int i = 0; i < n; ++i)C[i] = new double[n];
+    mean = new double[n];
+    C = alignedAlloc(rowOffset(n));
     tmp = new double[n];
+    before = alignedAlloc((size_t) 2 * BatchRows * n);
+    after = before + (size_t) BatchRows * n;
 
     // Inicializar variables
-    for (int i = 0; i < n; ++i)sum[i] = 0;
-    for (int i = 0; i < n; ++i)sum1[i] = 0;
-    for (int i = 0; i < n; ++i)sum2[i] = 0;
-    for (int i = 0; i < n; ++i)
-        for (int j = 0; j < n; ++j)C[i][j] = 0;
+    for (int i = 0; i < n; ++i)mean[i] = 0;
+    for (size_t i = 0; i < rowOffset(n); ++i)C[i] = 0;
 }
 
-void Cluster::update(const double *x) {
+void Cluster::accumulate(const double *x, double *dBefore, double *dAfter) {
     ++num;
     for (int i = 0; i < n; ++i) {
-        sum[i] += x[i];
-        tmp[i] = x[i] - sum[i] / num;
-        sum1[i] += tmp[i];
-        sum2[i] += tmp[i] * tmp[i];
+        dBefore[i] = x[i] - mean[i];
+        mean[i] += dBefore[i] / num;
+        dAfter[i] = x[i] - mean[i];
     }
+}
+
+void Cluster::rankUpdate(const double *dBefore, const double *dAfter, int k) {
+    // Fila a fila del triángulo: la fila (n - i valores) se queda en caché mientras se le suman las k muestras en orden.
+    // dBefore_i * dAfter_j = dBefore_i * dBefore_j * (num - 1) / num es simétrico, así que basta el triángulo superior
     for (int i = 0; i < n; ++i) {
-        for (int j = 0; j < n; ++j) {
-            C[i][j] += tmp[i] * tmp[j];
+        double *KITSUNE_RESTRICT row = C + rowOffset(i) - i;
+        int r = 0;
+        // De cuatro en cuatro muestras: una sola carga y escritura de la fila, con las sumas en el mismo orden
+        for (; r + 4 <= k; r += 4) {
+            const double *KITSUNE_RESTRICT d0 = dAfter + (size_t) r * n, *KITSUNE_RESTRICT d1 = d0 + n;
+            const double *KITSUNE_RESTRICT d2 = d1 + n, *KITSUNE_RESTRICT d3 = d2 + n;
+            const double *b = dBefore + (size_t) r * n + i;
+            double a0 = b[0], a1 = b[n], a2 = b[2 * n], a3 = b[3 * n];
+            for (int j = i; j < n; ++j)row[j] = row[j] + a0 * d0[j] + a1 * d1[j] + a2 * d2[j] + a3 * d3[j];
+        }
+        for (; r < k; ++r) {
+            const double *KITSUNE_RESTRICT d = dAfter + (size_t) r * n;
+            double di = dBefore[(size_t) r * n + i];
+            for (int j = i; j < n; ++j)row[j] += di * d[j];
         }
     }
 }
 
-std::vector<std::vector<int> > *Cluster::getFeatureMap(int maxSize) {
+void Cluster::update(const double *x) {
+    accumulate(x, before, after);
+    rankUpdate(before, after, 1);
+}
+
+void Cluster::updateBlock(const double *X, int rows) {
+    for (int r = 0; r < rows; r += BatchRows) {
+        int k = std::min(BatchRows, rows - r);
+        for (int s = 0; s < k; ++s)accumulate(X + (size_t) (r + s) * n, before + (size_t) s * n, after + (size_t) s * n);
+        rankUpdate(before, after, k);
+    }
+}
+
+void Cluster::update_batch(const double *X, int rows, WorkerPool *pool) {
+    int threads = pool == nullptr ? 1 : std::min(pool->size(), rows / ParallelRows);
+    if (threads <= 1) {
+        updateBlock(X, rows);
+        return;
+    }
+    // Un resumen parcial por hilo sobre un tramo contiguo, combinados después en el orden de los tramos
+    std::vector<Cluster *> partial(threads, nullptr);
+    for (int w = 0; w < threads; ++w)partial[w] = new Cluster(n);
+    pool->run([&](int w) {
+        if (w >= threads)return;
+        int begin = (int) ((long long) rows * w / threads), end = (int) ((long long) rows * (w + 1) / threads);
+        partial[w]->updateBlock(X + (size_t) begin * n, end - begin);
+    });
+    for (int w = 0; w < threads; ++w) {
+        merge(*partial[w]);
+        delete partial[w];
+    }
+}
+
+void Cluster::merge(const Cluster &other) {
+    if (other.n != n) {
+        fprintf(stderr, "KitNET: cannot merge cluster statistics of different sizes (%d, %d)\n", n, other.n);
+        throw -1;
+    }
+    if (other.num == 0)return;
+    long long total = num + other.num;
+    // delta = media de other - media propia; C += C_other + delta^T * delta * num * other.num / total
+    double factor = (double) num * other.num / total, weight = (double) other.num / total;
+    for (int i = 0; i < n; ++i)tmp[i] = other.mean[i] - mean[i];
+    for (int i = 0; i < n; ++i) {
+        double *KITSUNE_RESTRICT row = C + rowOffset(i) - i;
+        const double *KITSUNE_RESTRICT src = other.C + rowOffset(i) - i;
+        const double *KITSUNE_RESTRICT delta = tmp;
+        double di = delta[i] * factor;
+        for (int j = i; j < n; ++j)row[j] += src[j] + di * delta[j];
+    }
+    for (int i = 0; i < n; ++i)mean[i] += tmp[i] * weight;
+    num = total;
+}
+
+// Cabecera de los ficheros de estadísticas: identificador y versión del formato
+static const char ClusterMagic[8] = {'K', 'I', 'T', 'C', 'L', 'U', 'S', 'T'};
+static const uint32_t ClusterVersion = 1;
+
+// Formato (little-endian): identificador, versión y tamaño del vector (u32), número de muestras (u64),
+// medias y triángulo superior empaquetado de los co-momentos (f64)
+void Cluster::save(const char *filename) const {
+    BinaryWriter out(filename);
+    out.bytes(ClusterMagic, sizeof(ClusterMagic));
+    out.u32(ClusterVersion);
+    out.u32(n);
+    out.u64(num);
+    out.f64s(mean, n);
+    out.f64s(C, rowOffset(n));
+}
+
+Cluster *Cluster::load(const char *filename) {
+    MappedFile file(filename);
+    BinaryReader in(file.data(), file.size());
+    char magic[sizeof(ClusterMagic)];
+    in.bytes(magic, sizeof(magic));
+    if (std::memcmp(magic, ClusterMagic, sizeof(magic)) != 0) {
+        fprintf(stderr, "KitNET: not a cluster statistics file\n");
+        throw -1;
+    }
+    uint32_t version = in.u32();
+    if (version != ClusterVersion) {
+        fprintf(stderr, "KitNET: unsupported cluster statistics version %u\n", version);
+        throw -1;
+    }
+    uint32_t size = in.u32();
+    uint64_t count = in.u64();
+    // Antes de reservar nada, el resto del fichero debe contener las medias y el triángulo de co-momentos
+    // (size * (size + 1) / 2 valores, cuadrático en size)
+    size_t remaining = (file.size() - in.tell()) / sizeof(double);
+    if (size == 0 || size > remaining || (uint64_t) size * (size + 1) / 2 > remaining - size) {
+        fprintf(stderr, "KitNET: inconsistent sizes in cluster statistics file\n");
+        throw -1;
+    }
+    auto *cluster = new Cluster(size);
+    try {
+        cluster->num = count;
+        in.f64s(cluster->mean, size);
+        in.f64s(cluster->C, cluster->rowOffset(size));
+    } catch (...) {
+        delete cluster;
+        throw;
+    }
+    return cluster;
+}
+
+// Arista del agrupamiento de enlace simple entre las características id1 > id2
+struct LinkEdge {
+    double distance;
+    int id1, id2;
+};
+
+// Orden total de las aristas: distancia y, en los empates, índices. Con un orden total el árbol de expansión mínima es
+// único y Kruskal sobre sus aristas hace las mismas fusiones, en el mismo orden, que Kruskal sobre todas las parejas
+static inline bool edgeLess(const LinkEdge &a, const LinkEdge &b) {
+    if (a.distance != b.distance)return a.distance < b.distance;
+    if (a.id1 != b.id1)return a.id1 < b.id1;
+    return a.id2 < b.id2;
+}
+
+// Raíz del conjunto de x en el union-find, con compresión de caminos
+static int findRoot(std::vector<int> &parent, int x) {
+    int root = x;
+    while (parent[root] != root)root = parent[root];
+    while (parent[x] != root) {
+        int next = parent[x];
+        parent[x] = root;
+        x = next;
+    }
+    return root;
+}
+
+std::vector<std::vector<int> > *Cluster::getFeatureMap(int maxSize, WorkerPool *pool) {
     // Obtenga cada valor de cada característica menos la raíz cuadrada de la suma de cuadrados de la media (calcule el denominador del coeficiente de correlación)
     // Guárdelo en tmp.
     for (int i = 0; i < n; ++i) {
-        if (sum2[i] <= 0)tmp[i] = 0;
-        else tmp[i] = std::sqrt(sum2[i]);
+        double m2 = C[rowOffset(i)];
+        if (m2 <= 0)tmp[i] = 0;
+        else tmp[i] = std::sqrt(m2);
     }
-    std::vector<DisNode> dis;
-    dis.clear();
-    // Genere una matriz de distancia(indicada por triples) y solo obtenga la mitad de la matriz
-    for (int i = 0; i < n; ++i) {
-        for (int j = 0; j < i; ++j) {
-            double l = tmp[i] * tmp[j];
-            if (l <= 0)l = 1e-20;
-            l = 1 - C[i][j] / l;
-            if (l < 0)l = 0;
-            dis.emplace_back(i, j, l);
+    auto *ans = new std::vector<std::vector<int> >();
+    if (n == 0)return ans;
+
+    // Árbol de expansión mínima con Prim sobre la matriz de distancias implícita: cada distancia se calcula al vuelo
+    // y solo se guarda la mejor arista de cada característica que aún no está en el árbol, O(n) de memoria.
+    // En cada paso se relajan las aristas de la última característica añadida y se busca la siguiente, por bloques en paralelo
+    int threads = pool != nullptr && n >= 1024 ? pool->size() : 1;
+    std::vector<LinkEdge> best(n, LinkEdge{INFINITY, 0, 0});
+    std::vector<char> inTree(n, 0);
+    std::vector<int> candidate(threads);
+    std::vector<LinkEdge> tree;
+    tree.reserve(n - 1);
+    int last = 0;
+    inTree[0] = 1;
+    auto relaxBlock = [&](int w) {
+        int begin = (int) ((long long) n * w / threads), end = (int) ((long long) n * (w + 1) / threads);
+        int u = -1;
+        for (int v = begin; v < end; ++v) {
+            if (inTree[v])continue;
+            LinkEdge e = last > v ? LinkEdge{distance(last, v, tmp), last, v} : LinkEdge{distance(v, last, tmp), v, last};
+            if (edgeLess(e, best[v]))best[v] = e;
+            if (u < 0 || edgeLess(best[v], best[u]))u = v;
         }
+        candidate[w] = u;
+    };
+    for (int step = 1; step < n; ++step) {
+        if (threads > 1)pool->run(relaxBlock);
+        else relaxBlock(0);
+        int u = -1;
+        for (int c : candidate)
+            if (c >= 0 && (u < 0 || edgeLess(best[c], best[u])))u = c;
+        inTree[u] = 1;
+        tree.push_back(best[u]);
+        last = u;
     }
-    // Ordene la matriz por distancia y combine los dos grupos con la distancia más pequeña cada vez
-    std::sort(dis.begin(), dis.end());
 
-    std::vector<ClusterNode*> leaf; // Nodo hoja
-    leaf.clear();
-    for (int i = 0; i < n; ++i)leaf.push_back(new ClusterNode(i, 1));
+    // Dendrograma: Kruskal sobre las aristas del árbol con union-find. Los nodos 0 .. n - 1 son las hojas y cada fusión
+    // crea un nodo nuevo cuyo hijo izquierdo es el grupo de id1 y el derecho el de id2
+    std::sort(tree.begin(), tree.end(), edgeLess);
+    std::vector<int> parent(n), setSize(n, 1), setNode(n);
+    std::vector<int> lson(2 * n - 1, -1), rson(2 * n - 1, -1), size(2 * n - 1, 1);
+    for (int i = 0; i < n; ++i)parent[i] = setNode[i] = i;
     int now_id = n;
-    for (auto edge: dis) {
-        ClusterNode *root1 = leaf[edge.id1]->getRoot();
-        ClusterNode *root2 = leaf[edge.id2]->getRoot();
-        // Cuando los dos no están en el mismo clúster, se fusionan para generar un nuevo nodo
-        if (root1 != root2) {
-            auto *root = new ClusterNode(now_id++, root1->size + root2->size);
-            root1->fa = root;
-            root2->fa = root;
-            root->lson = root1;
-            root->rson = root2;
+    for (const LinkEdge &edge : tree) {
+        int root1 = findRoot(parent, edge.id1), root2 = findRoot(parent, edge.id2);
+        lson[now_id] = setNode[root1];
+        rson[now_id] = setNode[root2];
+        size[now_id] = size[setNode[root1]] + size[setNode[root2]];
+        // Unión por tamaño
+        if (setSize[root1] < setSize[root2])std::swap(root1, root2);
+        parent[root2] = root1;
+        setSize[root1] += setSize[root2];
+        setNode[root1] = now_id++;
+    }
+
+    // Corte el dendrograma en varios grupos, cada grupo no exceda maxSize; recorrido en profundidad con pila explícita,
+    // primero el hijo izquierdo
+    std::vector<int> stack(1, now_id - 1), leaves;
+    while (!stack.empty()) {
+        int node = stack.back();
+        stack.pop_back();
+        if (size[node] <= maxSize || lson[node] < 0) {
+            std::vector<int> group;
+            leaves.assign(1, node);
+            while (!leaves.empty()) {
+                int x = leaves.back();
+                leaves.pop_back();
+                if (lson[x] < 0)group.push_back(x);
+                else {
+                    leaves.push_back(rson[x]);
+                    leaves.push_back(lson[x]);
+                }
+            }
+            ans->push_back(group);
+        } else {
+            stack.push_back(rson[node]);
+            stack.push_back(lson[node]);
         }
     }
-    // Después de la fusión, todo debe estar en un árbol, es decir, se obtiene un dendrograma.
-    ClusterNode *root = leaf.back()->getRoot();
-    // Corte el dendrograma en varios grupos, cada grupo no exceda maxSize;
-    auto *ans = new std::vector<std::vector<int> >();
-    root->getSon(ans, maxSize);
-    // Libera la memoria del diagrama de árbol
-    delete root;
     return ans;
 }
 
 Cluster::~Cluster() {
-    delete[] sum;
-    delete[] sum1;
-    delete[] sum2;
-    for (int i = 0; i < n; ++i)delete[] C[i];
-    delete[] C;
+    delete[] mean;
+    alignedFree(C);
     delete[] tmp;
-}
-
-void ClusterNode::getSon(std::vector<std::vector<int>> *result, int max_size) {
-    if (size <= max_size) { // Si la cantidad actual de subárboles cumple con los requisitos, colóquelos todos en un grupo directamente
-        std::vector<int> ans;
-        ans.clear();
-        pushLeaf(ans);
-        result->push_back(ans);
-    }else{ // De lo contrario, se divide en dos grupos y se juzga de forma recursiva.
-        // Subárbol izquierdo
-        lson->getSon(result,max_size);
-        // Subárbol derecho
-        rson->getSon(result,max_size);
-    }
-}
-
-void ClusterNode::pushLeaf(std::vector<int> &result) {
-    if (lson == nullptr && rson == nullptr) {//leaf
-        result.push_back(id);
-    } else {
-        if (lson != nullptr)lson->pushLeaf(result);
-        if (rson != nullptr)rson->pushLeaf(result);
-    }
+    alignedFree(before);
 }
@@ -0,0 +1,162 @@
+//
+// Capa integrada de KitNET empaquetada en bloques contiguos.
+//
+
+#include "../include/ensemble.h"
+
+
+PackedEnsemble::PackedEnsemble(const std::vector<std::vector<int> > &featureMap, double vh_rate,
+                               double learning_rate) {
+    layout(featureMap, vh_rate);
+    params = alignedAlloc(paramCount());
+
+    // Pesos de inicialización distribuidos uniformemente, en el mismo orden que construir cada AE por separado
+    int total_w = wOffset[ae_num];
+    double *w = params, *dw = params + total_w;
+    for (int k = 0; k < ae_num; ++k) {
+        int v = vOffset[k + 1] - vOffset[k], h = hOffset[k + 1] - hOffset[k];
+        double val = 1.0 / h;
+        for (int i = 0; i < v * h; ++i)w[wOffset[k] + i] = rand_uniform(-val, val);
+        val = 1.0 / v;
+        for (int i = 0; i < h * v; ++i)dw[wOffset[k] + i] = rand_uniform(-val, val);
+    }
+    double *b = params + 2 * total_w;
+    for (int i = 0; i < total_h + total_v; ++i)b[i] = 0;
+    double *m = b + total_h + total_v;
+    for (int i = 0; i < total_v; ++i) {
+        m[i] = 1e20;
+        m[total_v + i] = -1e20;
+    }
+    attach(learning_rate);
+}
+
+PackedEnsemble::PackedEnsemble(const std::vector<std::vector<int> > &featureMap, double vh_rate,
+                               double learning_rate, double *storage) {
+    layout(featureMap, vh_rate);
+    params = storage;
+    ownsParams = false;
+    attach(learning_rate);
+}
+
+void PackedEnsemble::layout(const std::vector<std::vector<int> > &featureMap, double vh_rate) {
+    ae_num = featureMap.size();
+    vOffset.assign(ae_num + 1, 0);
+    hOffset.assign(ae_num + 1, 0);
+    wOffset.assign(ae_num + 1, 0);
+    // Aplanar el mapa de características y calcular el tamaño de cada autocodificador
+    for (int k = 0; k < ae_num; ++k) {
+        int v = featureMap[k].size();
+        int h = std::ceil(v * vh_rate);
+        for (int j : featureMap[k])featureIndex.push_back(j);
+        vOffset[k + 1] = vOffset[k] + v;
+        hOffset[k + 1] = hOffset[k] + h;
+        wOffset[k + 1] = wOffset[k] + v * h;
+    }
+    total_v = vOffset[ae_num];
+    total_h = hOffset[ae_num];
+}
+
+void PackedEnsemble::attach(double learning_rate) {
+    // Secciones del bloque único de parámetros
+    int total_w = wOffset[ae_num];
+    encW = params;
+    decW = encW + total_w;
+    encB = decW + total_w;
+    decB = encB + total_h;
+    min_v = decB + total_v;
+    max_v = min_v + total_v;
+
+    sx = new double[total_v];
+    sy = new double[total_h];
+    sz = new double[total_v];
+
+    // Núcleos especializados por tamaño del codificador y del decodificador de cada autocodificador
+    encKernels.resize(ae_num);
+    decKernels.resize(ae_num);
+    for (int k = 0; k < ae_num; ++k) {
+        encKernels[k] = selectDenseKernel(vOffset[k + 1] - vOffset[k], hOffset[k + 1] - hOffset[k]);
+        decKernels[k] = selectDenseKernel(hOffset[k + 1] - hOffset[k], vOffset[k + 1] - vOffset[k]);
+    }
+
+    layers = new AE<KitNETActivation> *[ae_num];
+    for (int k = 0; k < ae_num; ++k) {
+        AEStorage storage = {encW + wOffset[k], encB + hOffset[k], decW + wOffset[k], decB + vOffset[k],
+                             min_v + vOffset[k], max_v + vOffset[k]};
+        layers[k] = new AE<KitNETActivation>(vOffset[k + 1] - vOffset[k], hOffset[k + 1] - hOffset[k], learning_rate, storage);
+    }
+}
+
+PackedEnsemble::~PackedEnsemble() {
+    for (int k = 0; k < ae_num; ++k)delete layers[k];
+    delete[] layers;
+    delete[] sx;
+    delete[] sy;
+    delete[] sz;
+    if (ownsParams)alignedFree(params);
+}
+
+void PackedEnsemble::execute(const double *x, double *out, int begin, int end) {
+    // Reunir y normalizar todas las entradas en un solo barrido
+    for (int i = vOffset[begin]; i < vOffset[end]; ++i) {
+        double v = x[featureIndex[i]];
+        min_v[i] = std::min(v, min_v[i]);
+        max_v[i] = std::max(v, max_v[i]);
+        sx[i] = (v - min_v[i]) / (max_v[i] - min_v[i] + 1e-13);
+    }
+    forward(sx, sy, sz, out, begin, end);
+}
+
+void PackedEnsemble::execute(const double *x, double *out, double *sx, double *sy, double *sz, int begin,
+                             int end) const {
+    for (int i = vOffset[begin]; i < vOffset[end]; ++i)
+        sx[i] = (x[featureIndex[i]] - min_v[i]) / (max_v[i] - min_v[i] + 1e-13);
+    forward(sx, sy, sz, out, begin, end);
+}
+
+void PackedEnsemble::forward(const double *sx, double *sy, double *sz, double *out, int begin, int end) const {
+    // Codificar: GEMV diagonal por bloques, con el núcleo especializado de cada tamaño, y activación de todas las capas ocultas
+    for (int k = begin; k < end; ++k) {
+        if (encKernels[k] != nullptr)encKernels[k](encW + wOffset[k], encB + hOffset[k], sx + vOffset[k], sy + hOffset[k]);
+        else
+            denseForward(encW + wOffset[k], encB + hOffset[k], sx + vOffset[k], sy + hOffset[k],
+                         vOffset[k + 1] - vOffset[k], hOffset[k + 1] - hOffset[k]);
+    }
+    KitNETActivation::apply(sy + hOffset[begin], hOffset[end] - hOffset[begin]);
+    // Decodificar
+    for (int k = begin; k < end; ++k) {
+        if (decKernels[k] != nullptr)decKernels[k](decW + wOffset[k], decB + vOffset[k], sy + hOffset[k], sz + vOffset[k]);
+        else
+            denseForward(decW + wOffset[k], decB + vOffset[k], sy + hOffset[k], sz + vOffset[k],
+                         hOffset[k + 1] - hOffset[k], vOffset[k + 1] - vOffset[k]);
+    }
+    KitNETActivation::apply(sz + vOffset[begin], vOffset[end] - vOffset[begin]);
+    // Error de reconstrucción de cada autocodificador
+    for (int k = begin; k < end; ++k)
+        out[k] = RMSE(sx + vOffset[k], sz + vOffset[k], vOffset[k + 1] - vOffset[k]);
+}
+
+void PackedEnsemble::execute_batch(const double *X, int rows, int stride, double *out, int begin, int end) {
+    for (int r = 0; r < rows; ++r)execute(X + (size_t) r * stride, out + (size_t) r * ae_num, begin, end);
+}
+
+void PackedEnsemble::train(const double *x, double *out, int begin, int end) {
+    // Reunir las entradas en el búfer de la capa visible
+    for (int i = vOffset[begin]; i < vOffset[end]; ++i)sz[i] = x[featureIndex[i]];
+    for (int k = begin; k < end; ++k)out[k] = layers[k]->train(sz + vOffset[k]);
+}
+
+void PackedEnsemble::train_batch(const double *X, int rows, int stride, double *out, int begin, int end) {
+    std::vector<double> input, rmse(rows);
+    for (int k = begin; k < end; ++k) {
+        int v = vOffset[k + 1] - vOffset[k];
+        const int *index = featureIndex.data() + vOffset[k];
+        // Reúna las características de este autocodificador, una fila por muestra
+        input.resize(rows * v);
+        for (int r = 0; r < rows; ++r) {
+            const double *x = X + (size_t) r * stride;
+            for (int j = 0; j < v; ++j)input[r * v + j] = x[index[j]];
+        }
+        layers[k]->train_batch(input.data(), rows, rmse.data());
+        for (int r = 0; r < rows; ++r)out[r * ae_num + k] = rmse[r];
+    }
+}
@@ -2,6 +2,7 @@
 // Created by Yang Bo on 2020/5/9.
 //
 
+#include <algorithm>
 #include "../include/featureExtractor.h"
 
 
@@ -45,44 +46,65 @@ FE::FE(const char *filename, const std::vector<double> &lambdas, FileType ft) {
 // Lea las características de una fila de paquetes del lector y páselos a netstat para obtener el vector del siguiente conjunto de instancias.
 // Si tiene éxito, devuelve el número de vectores; de lo contrario, devuelve 0
 int FE::nextVector(double *result) {
+    return nextPacket(result, packet);
+}
+
+int FE::nextPacket(double *result, PacketInfo &info) {
+    if (!readPacket(info))return 0;
+    return computeVector(info, result);
+}
+
+bool FE::readPacket(PacketInfo &info) {
     int cols = tsvReader->nextLine();
-    if (cols == 0)return 0;
+    if (cols == 0)return false;
     if (fileType == FeatureTSV || fileType == FeatureCSV) { // Si lee la información del vector directamente, lea el doble directamente
         int num = getVectorSize();
-        if (cols < num)return 0;
-        for (int i = 0; i < num; ++i)result[i] = tsvReader->getDouble(i);
-        return num;
-    } else { // Estadísticas incrementales con netStat
-        std::string srcIP, dstIP;
-        if (tsvReader->hasValue(4)) {// Ipv4
-            srcIP = tsvReader->getString(4);
-            dstIP = tsvReader->getString(5);
-        } else { // Ipv6
-            srcIP = tsvReader->getString(17);
-            dstIP = tsvReader->getString(18);
-        }
-        std::string srcport, dstport;
-        if (tsvReader->hasValue(6)) {//tcp
-            srcport = tsvReader->getString(6);
-            dstport = tsvReader->getString(7);
-        } else if (tsvReader->hasValue(8)) { // udp
-            srcport = tsvReader->getString(8);
-            dstport = tsvReader->getString(9);
-        } else { // No es tcp ni udp, puede ser un paquete de 1,2 capas como arp o icmp
-            if (tsvReader->hasValue(10)) { // icmp
-                srcport = dstport = "icmp";
-            } else if (tsvReader->hasValue(12)) { // arp
-                srcport = dstport = "arp";
-                // Utilice la ip de origen y la ip de destino en el paquete arp como información de ip
-                srcIP = tsvReader->getString(14);
-                dstIP = tsvReader->getString(16);
-            } else { // Otros protocolos, utilizan la asignación de MAC de origen y destino
-                srcIP = tsvReader->getString(2);
-                dstIP = tsvReader->getString(3);
-            }
+        if (cols < num)return false;
+        info.values.resize(num);
+        for (int i = 0; i < num; ++i)info.values[i] = tsvReader->getDouble(i);
+        return true;
+    }
+    if (tsvReader->hasValue(4)) {// Ipv4
+        tsvReader->getString(4, info.srcIP);
+        tsvReader->getString(5, info.dstIP);
+    } else { // Ipv6
+        tsvReader->getString(17, info.srcIP);
+        tsvReader->getString(18, info.dstIP);
+    }
+    if (tsvReader->hasValue(6)) {//tcp
+        tsvReader->getString(6, info.srcPort);
+        tsvReader->getString(7, info.dstPort);
+    } else if (tsvReader->hasValue(8)) { // udp
+        tsvReader->getString(8, info.srcPort);
+        tsvReader->getString(9, info.dstPort);
+    } else { // No es tcp ni udp, puede ser un paquete de 1,2 capas como arp o icmp
+        if (tsvReader->hasValue(10)) { // icmp
+            info.srcPort = info.dstPort = "icmp";
+        } else if (tsvReader->hasValue(12)) { // arp
+            info.srcPort = info.dstPort = "arp";
+            // Utilice la ip de origen y la ip de destino en el paquete arp como información de ip
+            tsvReader->getString(14, info.srcIP);
+            tsvReader->getString(16, info.dstIP);
+        } else { // Otros protocolos, utilizan la asignación de MAC de origen y destino
+            info.srcPort.clear();
+            info.dstPort.clear();
+            tsvReader->getString(2, info.srcIP);
+            tsvReader->getString(3, info.dstIP);
         }
-        return netStat->updateAndGetStats(tsvReader->getString(2), tsvReader->getString(3),
-                                          srcIP, srcport, dstIP, dstport, tsvReader->getDouble(1),
-                                          tsvReader->getDouble(0), result);
     }
+    tsvReader->getString(2, info.srcMAC);
+    tsvReader->getString(3, info.dstMAC);
+    info.size = tsvReader->getDouble(1);
+    info.time = tsvReader->getDouble(0);
+    return true;
+}
+
+int FE::computeVector(const PacketInfo &info, double *result) {
+    if (fileType == FeatureTSV || fileType == FeatureCSV) {
+        std::copy(info.values.begin(), info.values.end(), result);
+        return info.values.size();
+    }
+    // Estadísticas incrementales con netStat
+    return netStat->updateAndGetStats(info.srcMAC, info.dstMAC, info.srcIP, info.srcPort, info.dstIP,
+                                      info.dstPort, info.size, info.time, result);
 }
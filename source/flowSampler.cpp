@@ -0,0 +1,80 @@
+//
+// Muestreo de la puntuación por flujo: los flujos masivos solo se puntúan cada k paquetes o cuando cambian.
+//
+
+#include <cmath>
+#include <algorithm>
+#include "../include/flowSampler.h"
+
+
+FlowSampler::FlowSampler(const NetStat &netStat, const FlowSamplingConfig &config) : config(config) {
+    if (netStat.getLambdas().empty() || !(netStat.getLambdas()[0] > 0) || config.rateThreshold < 0 ||
+        config.every < 1 || config.changeThreshold < 0 || config.idleTimeout <= 0) {
+        fprintf(stderr, "KitNET: invalid flow sampling parameters\n");
+        throw -1;
+    }
+    // El peso de la primera ventana es el primer valor del bloque de HT_Hp
+    lambda = netStat.getLambdas()[0];
+    offset = netStat.getHpOffset();
+    length = netStat.getHpLength();
+}
+
+double FlowSampler::flowRate(const double *x) const {
+    return x[offset] * lambda * M_LN2;
+}
+
+void FlowSampler::sweep(double now) {
+    for (auto it = flows.begin(); it != flows.end();) {
+        if (now - it->second.lastTime > config.idleTimeout)it = flows.erase(it);
+        else ++it;
+    }
+    lastSweep = now;
+}
+
+bool FlowSampler::admit(const PacketInfo &info, const double *x) {
+    ++seen;
+    if (info.time - lastSweep > config.idleTimeout)sweep(info.time);
+
+    // Misma clave que HT_Hp en NetStat
+    if (info.srcPort == "arp") {
+        key = info.srcMAC;
+        key += '>';
+        key += info.dstMAC;
+    } else {
+        key = info.srcIP;
+        key += info.srcPort;
+        key += '>';
+        key += info.dstIP;
+        key += info.dstPort;
+    }
+
+    const double *hp = x + offset;
+    if (flowRate(x) < config.rateThreshold) {
+        // Flujo lento: se puntúa siempre y, si venía de ser rápido, deja de muestrearse
+        if (!flows.empty())flows.erase(key);
+        ++scored;
+        return true;
+    }
+
+    auto found = flows.find(key);
+    if (found == flows.end()) {
+        Flow &flow = flows[key];
+        flow.reference.assign(hp, hp + length);
+        flow.lastTime = info.time;
+        ++scored;
+        return true;
+    }
+
+    Flow &flow = found->second;
+    flow.lastTime = info.time;
+    bool score = ++flow.skipped >= config.every;
+    for (int i = 0; i < length && !score; ++i) {
+        double ref = flow.reference[i];
+        score = std::fabs(hp[i] - ref) > config.changeThreshold * std::max(std::fabs(ref), 1e-3);
+    }
+    if (!score)return false;
+    std::copy(hp, hp + length, flow.reference.begin());
+    flow.skipped = 0;
+    ++scored;
+    return true;
+}
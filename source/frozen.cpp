@@ -0,0 +1,125 @@
+//
+// Plan de inferencia congelado de un KitNET entrenado.
+//
+
+#include <algorithm>
+#include "../include/frozen.h"
+
+
+FrozenKitNET::FrozenKitNET(KitNET &model) {
+    if (!model.isInitialized()) {
+        fprintf(stderr, "KitNET: only a trained model can be frozen\n");
+        throw -1;
+    }
+    PackedEnsemble *ensemble = model.getEnsembleLayer();
+    AE<KitNETActivation> *outputLayer = model.getOutputLayer();
+    inputSize = model.getInputSize();
+    ae_num = ensemble->size();
+    total_v = ensemble->totalVisible();
+    total_h = ensemble->totalHidden();
+    out_v = outputLayer->visibleSize();
+    out_h = outputLayer->hiddenSize();
+    featureIndex.assign(ensemble->features(), ensemble->features() + total_v);
+    vOffset.resize(ae_num + 1);
+    hOffset.resize(ae_num + 1);
+    wOffset.resize(ae_num + 1);
+    for (int k = 0; k <= ae_num; ++k) {
+        vOffset[k] = ensemble->visibleOffset(k);
+        hOffset[k] = ensemble->hiddenOffset(k);
+        wOffset[k] = ensemble->weightOffset(k);
+    }
+
+    // Bloque de parámetros
+    int total_w = wOffset[ae_num];
+    params = alignedAlloc((size_t) 2 * total_w + total_h + 3 * total_v + 2 * out_v * out_h + out_h + 3 * out_v);
+    encW = params;
+    decW = encW + total_w;
+    encB = decW + total_w;
+    decB = encB + total_h;
+    scale = decB + total_v;
+    offset = scale + total_v;
+    outEncW = offset + total_v;
+    outDecW = outEncW + out_v * out_h;
+    outEncB = outDecW + out_h * out_v;
+    outDecB = outEncB + out_h;
+    outScale = outDecB + out_v;
+    outOffset = outScale + out_v;
+
+    std::copy(ensemble->encoderWeights(), ensemble->encoderWeights() + total_w, encW);
+    std::copy(ensemble->decoderWeights(), ensemble->decoderWeights() + total_w, decW);
+    std::copy(ensemble->encoderBiases(), ensemble->encoderBiases() + total_h, encB);
+    std::copy(ensemble->decoderBiases(), ensemble->decoderBiases() + total_v, decB);
+    std::copy(outputLayer->getEncoder()->weights(), outputLayer->getEncoder()->weights() + out_v * out_h, outEncW);
+    std::copy(outputLayer->getDecoder()->weights(), outputLayer->getDecoder()->weights() + out_h * out_v, outDecW);
+    std::copy(outputLayer->getEncoder()->biases(), outputLayer->getEncoder()->biases() + out_h, outEncB);
+    std::copy(outputLayer->getDecoder()->biases(), outputLayer->getDecoder()->biases() + out_v, outDecB);
+
+    // Normalización plegada: (x - min) / (max - min + 1e-13) = x * scale + offset
+    const double *min_v = ensemble->minValues(), *max_v = ensemble->maxValues();
+    for (int i = 0; i < total_v; ++i) {
+        scale[i] = 1 / (max_v[i] - min_v[i] + 1e-13);
+        offset[i] = -min_v[i] * scale[i];
+    }
+    min_v = outputLayer->minValues();
+    max_v = outputLayer->maxValues();
+    for (int i = 0; i < out_v; ++i) {
+        outScale[i] = 1 / (max_v[i] - min_v[i] + 1e-13);
+        outOffset[i] = -min_v[i] * outScale[i];
+    }
+
+    // Núcleos especializados por tamaño
+    encKernels.resize(ae_num);
+    decKernels.resize(ae_num);
+    for (int k = 0; k < ae_num; ++k) {
+        encKernels[k] = selectDenseKernel(vOffset[k + 1] - vOffset[k], hOffset[k + 1] - hOffset[k]);
+        decKernels[k] = selectDenseKernel(hOffset[k + 1] - hOffset[k], vOffset[k + 1] - vOffset[k]);
+    }
+    outEncKernel = selectDenseKernel(out_v, out_h);
+    outDecKernel = selectDenseKernel(out_h, out_v);
+
+    // Variables temporales
+    scratch = alignedAlloc((size_t) 2 * total_v + total_h + 2 * out_v + out_h);
+    sx = scratch;
+    sz = sx + total_v;
+    sy = sz + total_v;
+    ox = sy + total_h;
+    oz = ox + out_v;
+    oy = oz + out_v;
+}
+
+FrozenKitNET::~FrozenKitNET() {
+    alignedFree(params);
+    alignedFree(scratch);
+}
+
+double FrozenKitNET::execute(const double *x) {
+    const int *index = featureIndex.data();
+    const int *vo = vOffset.data(), *ho = hOffset.data(), *wo = wOffset.data();
+    // Reunir y normalizar todas las entradas
+    for (int i = 0; i < total_v; ++i)sx[i] = x[index[i]] * scale[i] + offset[i];
+    // Capa integrada
+    for (int k = 0; k < ae_num; ++k) {
+        if (encKernels[k] != nullptr)encKernels[k](encW + wo[k], encB + ho[k], sx + vo[k], sy + ho[k]);
+        else denseForward(encW + wo[k], encB + ho[k], sx + vo[k], sy + ho[k], vo[k + 1] - vo[k], ho[k + 1] - ho[k]);
+    }
+    KitNETActivation::apply(sy, total_h);
+    for (int k = 0; k < ae_num; ++k) {
+        if (decKernels[k] != nullptr)decKernels[k](decW + wo[k], decB + vo[k], sy + ho[k], sz + vo[k]);
+        else denseForward(decW + wo[k], decB + vo[k], sy + ho[k], sz + vo[k], ho[k + 1] - ho[k], vo[k + 1] - vo[k]);
+    }
+    KitNETActivation::apply(sz, total_v);
+    for (int k = 0; k < ae_num; ++k)ox[k] = RMSE(sx + vo[k], sz + vo[k], vo[k + 1] - vo[k]);
+    // Capa de salida
+    for (int i = 0; i < out_v; ++i)ox[i] = ox[i] * outScale[i] + outOffset[i];
+    if (outEncKernel != nullptr)outEncKernel(outEncW, outEncB, ox, oy);
+    else denseForward(outEncW, outEncB, ox, oy, out_v, out_h);
+    KitNETActivation::apply(oy, out_h);
+    if (outDecKernel != nullptr)outDecKernel(outDecW, outDecB, oy, oz);
+    else denseForward(outDecW, outDecB, oy, oz, out_h, out_v);
+    KitNETActivation::apply(oz, out_v);
+    return RMSE(ox, oz, out_v);
+}
+
+void FrozenKitNET::execute_batch(const double *X, int rows, double *result) {
+    for (int r = 0; r < rows; ++r)result[r] = execute(X + (size_t) r * inputSize);
+}
@@ -3,37 +3,33 @@
 //
 
 #include "../include/kitNET.h"
+#include "../include/frozen.h"
 
 void KitNET::init() {
     if (kitNetParam == nullptr) {
         fprintf(stderr, "KITNET: KitNETParam must not be null\n");
         throw -1;
     }
+    fmSamples = kitNetParam->fm_seen;
     // Necesita agruparse para obtener la matriz de mapeo
     if (featureMap == nullptr) {
         if (kitNetParam->cluster == nullptr) {
             fprintf(stderr, "KITNET: the Cluster object must not be null\n");
         }
         // Agrupación para obtener mapas de características
-        featureMap = kitNetParam->cluster->getFeatureMap(kitNetParam->max_size);
+        featureMap = kitNetParam->cluster->getFeatureMap(kitNetParam->max_size, pool);
     }
 
     // Inicializar el codificador automático
-    ensembleLayer = new AE *[featureMap->size()];
-    for (int i = 0; i < featureMap->size(); ++i) {
-        ensembleLayer[i] = new AE(featureMap->at(i).size(),
-                                  std::ceil(featureMap->at(i).size() * kitNetParam->ensemble_vh_rate),
-                                  kitNetParam->ensemble_learning_rate);
-    }
-    outputLayer = new AE(featureMap->size(), std::ceil(featureMap->size() * kitNetParam->output_vh_rate),
-                         kitNetParam->output_learning_rate);
+    ensembleLayer = new PackedEnsemble(*featureMap, kitNetParam->ensemble_vh_rate,
+                                       kitNetParam->ensemble_learning_rate);
+    outputLayer = new AE<KitNETActivation>(featureMap->size(),
+                                           std::ceil(featureMap->size() * kitNetParam->output_vh_rate),
+                                           kitNetParam->output_learning_rate);
 
-    // Inicializar el búfer de parámetros de entrada desde el codificador
-    ensembleInput = new double *[featureMap->size()];
-    for (int i = 0; i < featureMap->size(); ++i) {
-        ensembleInput[i] = new double[featureMap->at(i).size()];
-    }
+    // Inicializar el búfer de entrada de la capa de salida
     outputInput = new double[featureMap->size()];
+    partitionEnsemble();
 
     for (auto &i : *featureMap) {
         fprintf(stderr, "[");
@@ -50,31 +46,30 @@ void KitNET::init() {
 // Incinerador de basuras
 KitNET::~KitNET() {
     delete kitNetParam; // Si es nulo, eliminar nulo no tiene ningún efecto, así que simplemente elimínelo directamente
-    for (int i = 0; i < featureMap->size(); ++i) {
-        delete ensembleLayer[i];
-        delete[] ensembleInput[i];
-    }
+    delete ensembleLayer;
     delete outputLayer;
     delete[] outputInput;
     delete featureMap;
+    delete pool;
+    // Los autocodificadores pueden apuntar al fichero del modelo, que se libera después de ellos
+    delete modelFile;
+    alignedFree(modelMemory);
 }
 
 double KitNET::train(const double *x) {
     if (featureMap == nullptr) { // Si el mapa de características no se ha inicializado
         --kitNetParam->fm_train_num;
+        ++kitNetParam->fm_seen;
         // Actualizar los valores mantenidos en el clúster
         kitNetParam->cluster->update(x);
         // Si el número de mapas de funciones de entrenamiento alcanza el valor establecido, inicialice el codificador automático
         if (kitNetParam->fm_train_num == 0)init();
+        else if (kitNetParam->fm_check_interval > 0 && kitNetParam->fm_seen % kitNetParam->fm_check_interval == 0)
+            checkFeatureMap();
         return 0;
     } else {// Autoencoder de tren
-        for (int i = 0; i < featureMap->size(); ++i) {
-            // Copie el vector de características correspondiente al búfer
-            for (int j = 0; j < featureMap->at(i).size(); ++j) {
-                ensembleInput[i][j] = x[featureMap->at(i).at(j)];
-            }
-            outputInput[i] = ensembleLayer[i]->train(ensembleInput[i]);
-        }
+        if (pool == nullptr)ensembleLayer->train(x, outputInput);
+        else pool->run([&](int w) { ensembleLayer->train(x, outputInput, partition[w], partition[w + 1]); });
         // Entrene la capa de salida, devuelva el error de reconstrucción
         return outputLayer->train(outputInput);
     }
@@ -85,13 +80,339 @@ double KitNET::execute(const double *x) {
         fprintf(stderr, "KitNET: the feature map is not initialized!!\n");
         throw -1;
     }
-    for (int i = 0; i < featureMap->size(); ++i) {
-        // Copie el vector de características correspondiente al búfer
-        for (int j = 0; j < featureMap->at(i).size(); ++j) {
-            ensembleInput[i][j] = x[featureMap->at(i).at(j)];
+    // Barrido fusionado de todos los pequeños codificadores automáticos; los errores de reconstrucción son la entrada de la capa de salida
+    if (pool == nullptr)ensembleLayer->execute(x, outputInput);
+    else pool->run([&](int w) { ensembleLayer->execute(x, outputInput, partition[w], partition[w + 1]); });
+    return outputLayer->reconstruct(outputInput);
+}
+
+KitNETContext::KitNETContext(const KitNET &model) {
+    if (!model.isInitialized()) {
+        fprintf(stderr, "KitNET: the feature map is not initialized!!\n");
+        throw -1;
+    }
+    int total_v = model.ensembleLayer->totalVisible(), total_h = model.ensembleLayer->totalHidden();
+    int out_v = model.outputLayer->visibleSize(), out_h = model.outputLayer->hiddenSize();
+    scratch = alignedAlloc((size_t) 2 * total_v + total_h + 3 * out_v + out_h);
+    sx = scratch;
+    sy = sx + total_v;
+    sz = sy + total_h;
+    ox = sz + total_v;
+    on = ox + out_v;
+    oy = on + out_v;
+    oz = oy + out_h;
+}
+
+double KitNET::execute(const double *x, KitNETContext &context) const {
+    if (featureMap == nullptr) { // Si el mapa de características no se ha inicializado
+        fprintf(stderr, "KitNET: the feature map is not initialized!!\n");
+        throw -1;
+    }
+    const PackedEnsemble *ensemble = ensembleLayer;
+    const AE<KitNETActivation> *output = outputLayer;
+    ensemble->execute(x, context.ox, context.sx, context.sy, context.sz, 0, ensemble->size());
+    return output->reconstruct(context.ox, context.on, context.oy, context.oz);
+}
+
+void KitNET::execute_batch(const double *X, int rows, double *result, KitNETContext &context) const {
+    for (int r = 0; r < rows; ++r)result[r] = execute(X + (size_t) r * inputSize, context);
+}
+
+void KitNET::execute_batch(const double *X, int rows, double *result) {
+    if (featureMap == nullptr) { // Si el mapa de características no se ha inicializado
+        fprintf(stderr, "KitNET: the feature map is not initialized!!\n");
+        throw -1;
+    }
+    int ae_num = ensembleLayer->size();
+    batchOutputInput.resize((size_t) rows * ae_num);
+    double *out = batchOutputInput.data();
+    if (pool == nullptr)ensembleLayer->execute_batch(X, rows, inputSize, out, 0, ae_num);
+    else
+        pool->run([&](int w) {
+            ensembleLayer->execute_batch(X, rows, inputSize, out, partition[w], partition[w + 1]);
+        });
+    // La capa de salida actualiza su normalización, así que se recorre en orden
+    for (int r = 0; r < rows; ++r)result[r] = outputLayer->reconstruct(out + (size_t) r * ae_num);
+}
+
+void KitNET::setAdaptiveFeatureMap(int check_interval, int stable_checks, int min_samples, double tolerance) {
+    if (featureMap != nullptr || kitNetParam == nullptr || kitNetParam->cluster == nullptr) {
+        fprintf(stderr, "KitNET: the adaptive feature map needs a model still in the feature-mapping phase\n");
+        throw -1;
+    }
+    if (check_interval < 1 || stable_checks < 1 || min_samples < 0 || tolerance < 0) {
+        fprintf(stderr, "KitNET: invalid adaptive feature map parameters\n");
+        throw -1;
+    }
+    kitNetParam->fm_check_interval = check_interval;
+    kitNetParam->fm_stable_checks = stable_checks;
+    kitNetParam->fm_min_samples = min_samples;
+    kitNetParam->fm_tolerance = tolerance;
+}
+
+void KitNET::checkFeatureMap() {
+    if (kitNetParam->fm_seen < kitNetParam->fm_min_samples)return;
+    auto *current = kitNetParam->cluster->getFeatureMap(kitNetParam->max_size, pool);
+    auto *&last = kitNetParam->fm_last_map;
+    if (last != nullptr && featureMapDistance(*last, *current) <= kitNetParam->fm_tolerance)++kitNetParam->fm_stable;
+    else kitNetParam->fm_stable = 0;
+    delete last;
+    last = current;
+    if (kitNetParam->fm_stable >= kitNetParam->fm_stable_checks) {
+        // El mapa ha convergido: se usa el del último punto de control
+        featureMap = last;
+        last = nullptr;
+        init();
+    }
+}
+
+double KitNET::featureMapDistance(const std::vector<std::vector<int> > &a, const std::vector<std::vector<int> > &b) {
+    int n = 0;
+    for (auto &group : a)
+        for (int f : group)n = std::max(n, f + 1);
+    for (auto &group : b)
+        for (int f : group)n = std::max(n, f + 1);
+    if (n == 0)return 0;
+    // Grupo de cada característica en b; una característica no se ha movido si su grupo de a tiene exactamente
+    // los mismos miembros en b
+    std::vector<int> label(n, -1);
+    std::vector<int> size(b.size());
+    for (size_t g = 0; g < b.size(); ++g) {
+        size[g] = b[g].size();
+        for (int f : b[g])label[f] = g;
+    }
+    int moved = 0;
+    for (auto &group : a) {
+        int g = label[group[0]];
+        bool same = g >= 0 && size[g] == (int) group.size();
+        for (int f : group)same = same && label[f] == g;
+        if (!same)moved += group.size();
+    }
+    return (double) moved / n;
+}
+
+void KitNET::setThreads(int threads, int spin) {
+    delete pool;
+    pool = nullptr;
+    if (threads > 1)pool = new WorkerPool(threads, spin);
+    partitionEnsemble();
+}
+
+void KitNET::partitionEnsemble() {
+    if (ensembleLayer == nullptr)return;
+    int ae_num = ensembleLayer->size();
+    int threads = pool == nullptr ? 1 : pool->size();
+    long long total = 0;
+    for (int k = 0; k < ae_num; ++k)total += ensembleLayer->cost(k);
+    // Cortes en los puntos donde el coste acumulado alcanza cada fracción del total
+    partition.assign(threads + 1, ae_num);
+    partition[0] = 0;
+    long long acc = 0;
+    int k = 0;
+    for (int w = 1; w < threads; ++w) {
+        while (k < ae_num && (acc + ensembleLayer->cost(k) / 2) * threads < total * w)acc += ensembleLayer->cost(k++);
+        partition[w] = k;
+    }
+}
+
+void KitNET::train_batch(const double *X, int rows, double *result) {
+    int r = 0;
+    // La fase de mapeo de características alimenta el clúster por bloques (actualización de rango k);
+    // la última muestra de la fase pasa por train, que construye los autocodificadores
+    while (r < rows && featureMap == nullptr) {
+        if (kitNetParam->fm_train_num > 1) {
+            int n = std::min(rows - r, kitNetParam->fm_train_num - 1);
+            // Los bloques terminan en los puntos de control de la fase adaptativa
+            int interval = kitNetParam->fm_check_interval;
+            if (interval > 0)n = std::min(n, interval - kitNetParam->fm_seen % interval);
+            kitNetParam->cluster->update_batch(X + (size_t) r * inputSize, n, pool);
+            kitNetParam->fm_train_num -= n;
+            kitNetParam->fm_seen += n;
+            if (result != nullptr)std::fill(result + r, result + r + n, 0.0);
+            r += n;
+            if (interval > 0 && kitNetParam->fm_seen % interval == 0)checkFeatureMap();
+        } else {
+            double score = train(X + (size_t) r * inputSize);
+            if (result != nullptr)result[r] = score;
+            ++r;
+        }
+    }
+    // El resto se entrena en mini lotes
+    while (r < rows) {
+        int n = std::min(batchSize, rows - r);
+        trainChunk(X + (size_t) r * inputSize, n, result == nullptr ? nullptr : result + r);
+        r += n;
+    }
+}
+
+void KitNET::trainChunk(const double *X, int rows, double *result) {
+    batchOutputInput.resize(rows * ensembleLayer->size());
+    double *out = batchOutputInput.data();
+    if (pool == nullptr)ensembleLayer->train_batch(X, rows, inputSize, out);
+    else
+        pool->run([&](int w) {
+            ensembleLayer->train_batch(X, rows, inputSize, out, partition[w], partition[w + 1]);
+        });
+    // Entrene la capa de salida con los errores de la capa integrada
+    outputLayer->train_batch(batchOutputInput.data(), rows, result);
+}
+
+FrozenKitNET *KitNET::freeze() {
+    return new FrozenKitNET(*this);
+}
+
+// Cabecera de los ficheros de modelo: identificador y versión del formato
+static const char ModelMagic[8] = {'K', 'I', 'T', 'N', 'E', 'T', 'M', 'D'};
+static const uint32_t ModelVersion = 1;
+
+/*
+ *  Formato (todo en little-endian):
+ *    identificador (8 bytes), versión, tamaño de la entrada, número de autocodificadores, tamaño del mapa aplanado,
+ *    tamaño de la capa oculta de salida (u32); proporciones oculta / visible y tasas de aprendizaje (f64);
+ *    tamaño de cada grupo del mapa y el mapa aplanado (i32); número de parámetros de la capa integrada y de la de salida (u64);
+ *    bloque de parámetros de la capa integrada (encW | decW | encB | decB | min_v | max_v) y bloque de la capa de salida
+ *    con la misma disposición, ambos alineados a KitsuneAlignment bytes.
+ *  Los pesos van antes que la normalización, así que al ejecutar un modelo proyectado solo se copian las últimas páginas
+ */
+void KitNET::save(const char *filename) {
+    if (featureMap == nullptr) {
+        fprintf(stderr, "KitNET: only a trained model can be saved\n");
+        throw -1;
+    }
+    int ae_num = featureMap->size();
+    int outV = outputLayer->visibleSize(), outH = outputLayer->hiddenSize();
+    BinaryWriter out(filename);
+    out.bytes(ModelMagic, sizeof(ModelMagic));
+    out.u32(ModelVersion);
+    out.u32(inputSize);
+    out.u32(ae_num);
+    out.u32(ensembleLayer->totalVisible());
+    out.u32(outH);
+    out.f64(ensembleVhRate);
+    out.f64(outputVhRate);
+    out.f64(ensembleLearningRate);
+    out.f64(outputLearningRate);
+    for (auto &group : *featureMap)out.u32(group.size());
+    for (auto &group : *featureMap)out.i32s(group.data(), group.size());
+    out.u64(ensembleLayer->paramCount());
+    out.u64((size_t) 2 * outV * outH + outH + 3 * outV);
+
+    out.align(KitsuneAlignment);
+    out.f64s(ensembleLayer->parameters(), ensembleLayer->paramCount());
+    out.align(KitsuneAlignment);
+    out.f64s(outputLayer->getEncoder()->weights(), (size_t) outV * outH);
+    out.f64s(outputLayer->getDecoder()->weights(), (size_t) outH * outV);
+    out.f64s(outputLayer->getEncoder()->biases(), outH);
+    out.f64s(outputLayer->getDecoder()->biases(), outV);
+    out.f64s(outputLayer->minValues(), outV);
+    out.f64s(outputLayer->maxValues(), outV);
+}
+
+KitNET *KitNET::load(const char *filename) {
+    auto *model = new KitNET();
+    try {
+        model->modelFile = new MappedFile(filename);
+        model->readModel();
+    } catch (...) {
+        delete model;
+        throw;
+    }
+    return model;
+}
+
+void KitNET::readModel() {
+    BinaryReader in(modelFile->data(), modelFile->size());
+    char magic[sizeof(ModelMagic)];
+    in.bytes(magic, sizeof(magic));
+    if (std::memcmp(magic, ModelMagic, sizeof(magic)) != 0) {
+        fprintf(stderr, "KitNET: not a KitNET model file\n");
+        throw -1;
+    }
+    uint32_t version = in.u32();
+    if (version != ModelVersion) {
+        fprintf(stderr, "KitNET: unsupported model version %u\n", version);
+        throw -1;
+    }
+    inputSize = in.u32();
+    int ae_num = in.u32(), total_v = in.u32(), outH = in.u32();
+    // Cada autocodificador ocupa al menos 4 bytes en el fichero
+    if (ae_num <= 0 || total_v <= 0 || (size_t) ae_num > modelFile->size() || (size_t) total_v > modelFile->size()) {
+        fprintf(stderr, "KitNET: inconsistent sizes in model file\n");
+        throw -1;
+    }
+    ensembleVhRate = in.f64();
+    outputVhRate = in.f64();
+    ensembleLearningRate = in.f64();
+    outputLearningRate = in.f64();
+    // Las proporciones fijan el tamaño de las capas ocultas (ceil(v * rate) convertido a int): antes de construir nada
+    if (!(ensembleVhRate > 0) || ensembleVhRate > 1 || !(outputVhRate > 0) || outputVhRate > 1 ||
+        !std::isfinite(ensembleLearningRate) || !std::isfinite(outputLearningRate)) {
+        fprintf(stderr, "KitNET: invalid hyperparameters in model file\n");
+        throw -1;
+    }
+
+    // Mapa de características
+    std::vector<int> sizes(ae_num);
+    in.i32s(sizes.data(), ae_num);
+    featureMap = new std::vector<std::vector<int> >(ae_num);
+    long long mapped = 0;
+    for (int k = 0; k < ae_num; ++k) {
+        if (sizes[k] <= 0 || (mapped += sizes[k]) > total_v) {
+            fprintf(stderr, "KitNET: corrupt feature map in model file\n");
+            throw -1;
         }
-        // Ejecute este pequeño codificador automático y guarde el error de reconstrucción como entrada de la capa de salida
-        outputInput[i] = ensembleLayer[i]->reconstruct(ensembleInput[i]);
+        (*featureMap)[k].resize(sizes[k]);
+        in.i32s((*featureMap)[k].data(), sizes[k]);
+        for (int j : (*featureMap)[k])
+            if (j < 0 || j >= inputSize) {
+                fprintf(stderr, "KitNET: feature index %d out of range in model file\n", j);
+                throw -1;
+            }
     }
-    return outputLayer->reconstruct(outputInput);
+    uint64_t ensembleCount = in.u64(), outputCount = in.u64();
+    if (mapped != total_v || outH <= 0 || outputCount != (uint64_t) 2 * ae_num * outH + outH + 3 * ae_num) {
+        fprintf(stderr, "KitNET: inconsistent sizes in model file\n");
+        throw -1;
+    }
+
+    // Bloques de parámetros: directamente desde el fichero si el orden de bytes coincide, si no una copia convertida
+    double *ensembleParams, *outputParams;
+    in.align(KitsuneAlignment);
+    if (hostLittleEndian()) {
+        // Proyección privada: las escrituras copian solo las páginas afectadas
+        ensembleParams = (double *) (modelFile->data() + in.tell());
+        in.skip(ensembleCount * sizeof(double));
+        in.align(KitsuneAlignment);
+        outputParams = (double *) (modelFile->data() + in.tell());
+        in.skip(outputCount * sizeof(double));
+    } else {
+        modelMemory = alignedAlloc(ensembleCount + outputCount);
+        ensembleParams = modelMemory;
+        outputParams = modelMemory + ensembleCount;
+        in.f64s(ensembleParams, ensembleCount);
+        in.align(KitsuneAlignment);
+        in.f64s(outputParams, outputCount);
+    }
+
+    bindParameters(ensembleParams, outputParams, outH);
+    if (ensembleLayer->paramCount() != ensembleCount) {
+        fprintf(stderr, "KitNET: inconsistent sizes in model file\n");
+        throw -1;
+    }
+    outputInput = new double[ae_num];
+    partitionEnsemble();
+}
+
+void KitNET::bindParameters(double *ensembleParams, double *outputParams, int outH) {
+    ensembleLayer = new PackedEnsemble(*featureMap, ensembleVhRate, ensembleLearningRate, ensembleParams);
+    int outV = featureMap->size();
+    double *p = outputParams;
+    AEStorage storage;
+    storage.encW = p;
+    storage.decW = p += outV * outH;
+    storage.encB = p += outH * outV;
+    storage.decB = p += outH;
+    storage.min_v = p += outV;
+    storage.max_v = p + outV;
+    outputLayer = new AE<KitNETActivation>(outV, outH, outputLearningRate, storage);
 }
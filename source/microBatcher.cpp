@@ -0,0 +1,68 @@
+//
+// Planificador de mini lotes con latencia acotada para la ejecución de KitNET.
+//
+
+#include <algorithm>
+#include "../include/microBatcher.h"
+
+
+MicroBatcher::MicroBatcher(KitNET *model, const MicroBatchConfig &config)
+        : model(model), n(model->getInputSize()), config(config), batchSize(config.maxBatch) {
+    if (config.maxBatch < 1 || config.deadlineUs < 0 || config.p99TargetUs < 0 || config.window < 1) {
+        fprintf(stderr, "KitNET: invalid micro-batching parameters\n");
+        throw -1;
+    }
+    X.resize((size_t) config.maxBatch * n);
+    packets.resize(config.maxBatch);
+    arrivals.resize(config.maxBatch);
+    scores.resize(config.maxBatch);
+    latencies.reserve(config.window);
+}
+
+bool MicroBatcher::submit(const double *x, long long packet, Clock::time_point arrival) {
+    std::copy(x, x + n, X.begin() + (size_t) count * n);
+    packets[count] = packet;
+    arrivals[count] = arrival;
+    if (++count >= batchSize) {
+        flush();
+        return true;
+    }
+    return false;
+}
+
+double MicroBatcher::untilDeadlineUs() const {
+    if (count == 0)return 0;
+    return config.deadlineUs - std::chrono::duration<double, std::micro>(Clock::now() - arrivals[0]).count();
+}
+
+bool MicroBatcher::poll() {
+    if (count == 0 || untilDeadlineUs() > 0)return false;
+    flush();
+    return true;
+}
+
+void MicroBatcher::flush() {
+    if (count == 0)return;
+    model->execute_batch(X.data(), count, scores.data());
+    Clock::time_point done = Clock::now();
+    for (int i = 0; i < count; ++i) {
+        double latency = std::chrono::duration<double, std::micro>(done - arrivals[i]).count();
+        if (onScore)onScore(packets[i], scores[i], latency);
+        latencies.push_back(latency);
+        if ((int) latencies.size() == config.window)adapt();
+    }
+    scored += count;
+    ++batches;
+    count = 0;
+}
+
+void MicroBatcher::adapt() {
+    size_t k = latencies.size() * 99 / 100;
+    std::nth_element(latencies.begin(), latencies.begin() + k, latencies.end());
+    p99 = latencies[k];
+    latencies.clear();
+    if (config.p99TargetUs <= 0)return;
+    // Crecimiento aditivo y reducción multiplicativa del tamaño de lote
+    if (p99 > config.p99TargetUs)batchSize = std::max(1, batchSize / 2);
+    else if (p99 < 0.8 * config.p99TargetUs)batchSize = std::min(config.maxBatch, batchSize + 1);
+}
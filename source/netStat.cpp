@@ -364,21 +364,24 @@ int NetStat::updateAndGetStats(const std::string &srcMAC, const std::string &dst
     int offset = 0; // Desplazamiento de la matriz(el número de colocados actualmente)
 
     // MAC.IP: Estadísticas de origen de host MAC e relación IP y ancho de banda
-    offset += HT_MI->updateGet1DStats(srcMAC + srcIP, timestamp, datagramSize, result);
+    key1.assign(srcMAC).append(srcIP);
+    offset += HT_MI->updateGet1DStats(key1, timestamp, datagramSize, result);
 
     // Host-Host BW: Estadísticas del flujo de envío del host IP de origen (relación unidimensional), relación bidimensional entre el comportamiento de envío del host IP de origen y el host IP de destino
     offset += HT_H->updateGet1D2DStats(srcIP, dstIP, timestamp, datagramSize, result + offset);
 
     // Host-Host Jitter: Fluctuación entre el host y el host
-    offset += HT_jit->updateGet1DStats(srcIP + dstIP, timestamp, 0, result + offset, true);
+    key1.assign(srcIP).append(dstIP);
+    offset += HT_jit->updateGet1DStats(key1, timestamp, 0, result + offset, true);
 
     // Host-Host BW: Estadísticas del flujo de envío del puerto IP de origen (relación unidimensional) Relación del comportamiento de envío entre el puerto IP de origen y el puerto IP de destino (relación bidimensional)
     // Si no es un paquete tcp / udp, deje que la dirección mac sea el valor clave de la transmisión.
     if (srcProtocol == "arp") {
         offset += HT_Hp->updateGet1D2DStats(srcMAC, dstMAC, timestamp, datagramSize, result + offset);
     } else {
-        offset += HT_Hp->updateGet1D2DStats(srcIP + srcProtocol, dstIP + dstProtocol, timestamp,
-                                            datagramSize, result + offset);
+        key1.assign(srcIP).append(srcProtocol);
+        key2.assign(dstIP).append(dstProtocol);
+        offset += HT_Hp->updateGet1D2DStats(key1, key2, timestamp, datagramSize, result + offset);
     }
     return offset;
 }
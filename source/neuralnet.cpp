@@ -5,43 +5,64 @@
 #include "../include/neuralnet.h"
 
 
-Dense::Dense(int inSize, int outSize, double (*activationFunc)(double), double (*activationDerivativeFunc)(double),
-             double lr) {
+template<class Activation>
+Dense<Activation>::Dense(int inSize, int outSize, double lr) {
     n_in = inSize;
     n_out = outSize;
-    activation = activationFunc;
-    activationDerivative = activationDerivativeFunc;
     learning_rate = lr;
-    inputValue = new double[n_in];
-    outputValue = new double[n_out];
+    allocTemporaries();
     bias = new double[n_out];
-    W = new double *[n_in];// n_en fila, n_out columna
-    for (int i = 0; i < n_in; ++i)W[i] = new double[n_out];
+    W = alignedAlloc((size_t) n_in * n_out);// n_en fila, n_out columna
 
     double val = 1.0 / n_out;
     // Pesos de inicialización distribuidos uniformemente
     for (int i = 0; i < n_in; ++i) {
-        for (int j = 0; j < n_out; ++j)W[i][j] = rand_uniform(-val, val);
+        for (int j = 0; j < n_out; ++j)W[i * n_out + j] = rand_uniform(-val, val);
     }
     for (int i = 0; i < n_out; ++i)bias[i] = 0;
 }
 
-Dense::~Dense() {
-    delete[] bias;
+template<class Activation>
+Dense<Activation>::Dense(int inSize, int outSize, double lr, double *weights, double *biases) {
+    n_in = inSize;
+    n_out = outSize;
+    learning_rate = lr;
+    allocTemporaries();
+    W = weights;
+    bias = biases;
+    ownsParams = false;
+}
+
+template<class Activation>
+void Dense<Activation>::allocTemporaries() {
+    inputValue = new double[n_in];
+    outputValue = new double[n_out];
+    delta = new double[n_out];
+    forwardKernel = selectDenseKernel(n_in, n_out);
+}
+
+template<class Activation>
+Dense<Activation>::~Dense() {
+    if (ownsParams) {
+        delete[] bias;
+        alignedFree(W);
+    }
     delete[] inputValue;
     delete[] outputValue;
-    for (int i = 0; i < n_in; ++i)delete[] W[i];
-    delete[] W;
+    delete[] delta;
 }
 
-void Dense::feedForward(const double *input, double *output, bool saveValue) {
-    for (int i = 0; i < n_out; ++i) {
-        output[i] = bias[i];
-        for (int j = 0; j < n_in; ++j) {
-            output[i] += W[j][i] * input[j];
-        }
-        output[i] = activation(output[i]);
-    }
+template<class Activation>
+void Dense<Activation>::forward(const double *input, double *output) const {
+    // GEMV contiguo (núcleo especializado si la capa es pequeña), después la función de activación
+    if (forwardKernel != nullptr)forwardKernel(W, bias, input, output);
+    else denseForward(W, bias, input, output, n_in, n_out);
+    Activation::apply(output, n_out);
+}
+
+template<class Activation>
+void Dense<Activation>::feedForward(const double *input, double *output, bool saveValue) {
+    forward(input, output);
     if (saveValue) {
         std::memcpy(inputValue, input, sizeof(double) * n_in);
         std::memcpy(outputValue, output, sizeof(double) * n_out);
@@ -49,48 +70,63 @@ void Dense::feedForward(const double *input, double *output, bool saveValue) {
 }
 
 // SGD
-void Dense::BackPropagation(double *g) {
-    for (int i = 0; i < n_out; ++i)outputValue[i] = g[i] * activationDerivative(outputValue[i]);
-
-    // Calcule el error propagado a la capa superior.
-    for (int i = 0; i < n_in; ++i) {
-        g[i] = 0;
-        for (int j = 0; j < n_out; ++j) {
-            g[i] += W[i][j] * outputValue[j];
-        }
-    }
+template<class Activation>
+void Dense<Activation>::BackPropagation(double *g) {
+    for (int i = 0; i < n_out; ++i)delta[i] = g[i] * Activation::df(outputValue[i]);
 
     // Actualice el umbral, por cierto, multiplique learning_rate por el guardado, no es necesario calcular al actualizar el peso
     for (int i = 0; i < n_out; ++i) {
-        outputValue[i] *= learning_rate;
+        outputValue[i] = delta[i] * learning_rate;
         bias[i] += outputValue[i];
     }
 
-    // Actualizar peso
-    for (int i = 0; i < n_in; ++i) {
-        for (int j = 0; j < n_out; ++j) {
-            W[i][j] += inputValue[i] * outputValue[j];
-        }
+    // Calcule el error propagado a la capa superior y actualice el peso en la misma pasada
+    denseBackward(W, inputValue, delta, outputValue, g, n_in, n_out);
+}
+
+template<class Activation>
+void Dense<Activation>::feedForwardBatch(const double *X, double *Y, int rows, bool saveValue) {
+    // GEMM del lote, después la función de activación
+    denseForwardBatch(W, bias, X, Y, rows, n_in, n_out);
+    Activation::apply(Y, rows * n_out);
+    if (saveValue) {
+        batchInput.assign(X, X + rows * n_in);
+        batchOutput.assign(Y, Y + rows * n_out);
     }
 }
 
+// SGD por mini lotes
+template<class Activation>
+void Dense<Activation>::BackPropagationBatch(const double *G, double *GIn, int rows) {
+    batchDelta.resize(rows * n_out);
+    double rate = learning_rate / rows; // Tasa de aprendizaje del gradiente medio
+    // Gradiente local; batchOutput pasa a guardar el gradiente multiplicado por la tasa, como en BackPropagation
+    for (int i = 0; i < rows * n_out; ++i) {
+        batchDelta[i] = G[i] * Activation::df(batchOutput[i]);
+        batchOutput[i] = batchDelta[i] * rate;
+    }
+    // Actualizar el umbral
+    for (int r = 0; r < rows; ++r) {
+        for (int i = 0; i < n_out; ++i)bias[i] += batchOutput[r * n_out + i];
+    }
+    // Error propagado y actualización de los pesos
+    denseBackwardBatch(W, batchInput.data(), batchDelta.data(), batchOutput.data(), GIn, rows, n_in, n_out);
+}
+
 
 // Constructor, el parámetro es el número de capas explícitas y ocultas.
 
-AE::AE(int v_sz, int h_sz, double _learning_rate) {
+template<class Activation>
+AE<Activation>::AE(int v_sz, int h_sz, double _learning_rate) {
     visible_size = v_sz;
     hidden_size = h_sz;
 
-    // Inicializa dos capas de redes neuronales, ambas usan la función de activación sigmoidea
-    encoder = new Dense(visible_size, hidden_size, sigmoid, sigmoidDerivative, _learning_rate);
-    decoder = new Dense(hidden_size, visible_size, sigmoid, sigmoidDerivative, _learning_rate);
+    // Inicializa dos capas de redes neuronales, ambas usan la función de activación Activation
+    encoder = new Dense<Activation>(visible_size, hidden_size, _learning_rate);
+    decoder = new Dense<Activation>(hidden_size, visible_size, _learning_rate);
 
     // Inicializar una matriz de variables temporales
-    tmp_x = new double[visible_size];
-    tmp_z = new double[visible_size];
-    tmp_y = new double[hidden_size];
-    // tmp_g es el búfer utilizado para propagar el gradiente, por lo que el tamaño es el valor máximo de cada capa
-    tmp_g = new double[std::max(hidden_size, visible_size)];
+    allocTemporaries();
 
     // Inicializar la matriz requerida para la normalización
     max_v = new double[visible_size];
@@ -101,21 +137,49 @@ AE::AE(int v_sz, int h_sz, double _learning_rate) {
     }
 }
 
+template<class Activation>
+AE<Activation>::AE(int v_sz, int h_sz, double _learning_rate, const AEStorage &storage) {
+    visible_size = v_sz;
+    hidden_size = h_sz;
+
+    // Las dos capas trabajan directamente sobre los pesos externos
+    encoder = new Dense<Activation>(visible_size, hidden_size, _learning_rate, storage.encW, storage.encB);
+    decoder = new Dense<Activation>(hidden_size, visible_size, _learning_rate, storage.decW, storage.decB);
+    allocTemporaries();
+    min_v = storage.min_v;
+    max_v = storage.max_v;
+    ownsParams = false;
+}
+
+template<class Activation>
+void AE<Activation>::allocTemporaries() {
+    tmp_x = new double[visible_size];
+    tmp_z = new double[visible_size];
+    tmp_y = new double[hidden_size];
+    // tmp_g es el búfer utilizado para propagar el gradiente, por lo que el tamaño es el valor máximo de cada capa
+    tmp_g = new double[std::max(hidden_size, visible_size)];
+}
+
 // Incinerador de basuras
-AE::~AE() {
+template<class Activation>
+AE<Activation>::~AE() {
     delete encoder;
     delete decoder;
     delete[] tmp_x;
     delete[] tmp_y;
     delete[] tmp_z;
-    delete[] max_v;
-    delete[] min_v;
+    delete[] tmp_g;
+    if (ownsParams) {
+        delete[] max_v;
+        delete[] min_v;
+    }
 }
 
 
 // Reconstruir, devolver el valor reconstruido
-double AE::reconstruct(const double *x) {
-    normalize(x); // Primero normalice y guarde en tmp_x
+template<class Activation>
+double AE<Activation>::reconstruct(const double *x) {
+    normalize(x, tmp_x); // Primero normalice y guarde en tmp_x
 
     encoder->feedForward(tmp_x, tmp_y); // Codificación, almacenada en tmp_y
 
@@ -124,9 +188,18 @@ double AE::reconstruct(const double *x) {
     return RMSE(tmp_x, tmp_z, visible_size);
 }
 
+template<class Activation>
+double AE<Activation>::reconstruct(const double *x, double *tx, double *ty, double *tz) const {
+    normalizeFrozen(x, tx);
+    encoder->forward(tx, ty);
+    decoder->forward(ty, tz);
+    return RMSE(tx, tz, visible_size);
+}
+
 // capacitación
-double AE::train(const double *x) {
-    normalize(x); // Regularización 0-1, almacenada en tmp_x
+template<class Activation>
+double AE<Activation>::train(const double *x) {
+    normalize(x, tmp_x); // Regularización 0-1, almacenada en tmp_x
     // Ejecútelo hacia adelante, establezca el parámetro saveValue en verdadero y prepárese para propagar el error de regreso
     encoder->feedForward(tmp_x, tmp_y, true);
     decoder->feedForward(tmp_y, tmp_z, true);
@@ -140,11 +213,67 @@ double AE::train(const double *x) {
     return RMSE(tmp_x, tmp_z, visible_size);
 }
 
-// 0-1 normalizado, el resultado se almacena en tmp_x
-void AE::normalize(const double *x) {
+// Capacitación por mini lotes
+template<class Activation>
+double AE<Activation>::train_batch(const double *X, int rows, double *rmse) {
+    batch_x.resize(rows * visible_size);
+    batch_z.resize(rows * visible_size);
+    batch_g.resize(rows * visible_size);
+    batch_y.resize(rows * hidden_size);
+    batch_gh.resize(rows * hidden_size);
+
+    // Cada muestra se normaliza con los valores máximos y mínimos vistos hasta ella, igual que en train
+    for (int r = 0; r < rows; ++r)normalize(X + r * visible_size, &batch_x[r * visible_size]);
+    encoder->feedForwardBatch(batch_x.data(), batch_y.data(), rows, true);
+    decoder->feedForwardBatch(batch_y.data(), batch_z.data(), rows, true);
+
+    double total = 0;
+    for (int r = 0; r < rows; ++r) {
+        const double *bx = &batch_x[r * visible_size];
+        const double *bz = &batch_z[r * visible_size];
+        double e = RMSE(bx, bz, visible_size);
+        if (rmse != nullptr)rmse[r] = e;
+        total += e;
+        for (int i = 0; i < visible_size; ++i)batch_g[r * visible_size + i] = bx[i] - bz[i];
+    }
+    // Error de retropropagación; el codificador no necesita propagar el error a la entrada
+    decoder->BackPropagationBatch(batch_g.data(), batch_gh.data(), rows);
+    encoder->BackPropagationBatch(batch_gh.data(), nullptr, rows);
+
+    return total / rows;
+}
+
+// 0-1 normalizado, el resultado se almacena en out
+template<class Activation>
+void AE<Activation>::normalize(const double *x, double *out) {
     for (int i = 0; i < visible_size; ++i) {
         min_v[i] = std::min(x[i], min_v[i]);
         max_v[i] = std::max(x[i], max_v[i]);
-        tmp_x[i] = (x[i] - min_v[i]) / (max_v[i] - min_v[i] + 1e-13);
+        out[i] = (x[i] - min_v[i]) / (max_v[i] - min_v[i] + 1e-13);
     }
 }
+
+template<class Activation>
+void AE<Activation>::normalizeFrozen(const double *x, double *out) const {
+    for (int i = 0; i < visible_size; ++i)out[i] = (x[i] - min_v[i]) / (max_v[i] - min_v[i] + 1e-13);
+}
+
+
+// Instanciaciones explícitas de las políticas de activación de utils.h
+template class Dense<SigmoidActivation>;
+template class Dense<FastSigmoidActivation<SigmoidLow> >;
+template class Dense<FastSigmoidActivation<SigmoidMedium> >;
+template class Dense<FastSigmoidActivation<SigmoidHigh> >;
+template class Dense<IdentityActivation>;
+template class Dense<ReLUActivation>;
+template class Dense<PReLUActivation>;
+template class Dense<ELUActivation>;
+
+template class AE<SigmoidActivation>;
+template class AE<FastSigmoidActivation<SigmoidLow> >;
+template class AE<FastSigmoidActivation<SigmoidMedium> >;
+template class AE<FastSigmoidActivation<SigmoidHigh> >;
+template class AE<IdentityActivation>;
+template class AE<ReLUActivation>;
+template class AE<PReLUActivation>;
+template class AE<ELUActivation>;
@@ -0,0 +1,115 @@
+//
+// Protección frente a sobrecarga: descarte adaptativo de trabajo, primero de la puntuación y después de NetStat.
+//
+
+#include <cmath>
+#include <algorithm>
+#include <functional>
+#include "../include/overload.h"
+
+
+OverloadController::OverloadController(const OverloadConfig &config)
+        : config(config), packets(0), statShed(0), scorable(0), scoreShed(0), statRate(0), scoreRate(0),
+          statPressureNow(0), scorePressureNow(0), peakLag(0), lagPressure(0) {
+    if (config.scoreStart < 0 || config.scoreStart >= 1 || config.statStart < 0 || config.statStart >= 1 ||
+        config.scoreMaxShed < 0 || config.scoreMaxShed > 1 || config.statMaxShed < 0 || config.statMaxShed > 1 ||
+        config.maxLag < 0 || config.smoothing <= 0 || config.smoothing > 1 || !(config.statStep > 0) ||
+        config.statStep > 1) {
+        fprintf(stderr, "KitNET: invalid overload parameters\n");
+        throw -1;
+    }
+}
+
+double OverloadController::shedRate(double pressure, double start, double maxShed) {
+    if (pressure <= start)return 0;
+    return std::min(1.0, (pressure - start) / (1 - start)) * maxShed;
+}
+
+double OverloadController::flowHash(const PacketInfo &info) {
+    std::hash<std::string> hasher;
+    size_t a = hasher(info.srcIP), b = hasher(info.dstIP);
+    if (a > b)std::swap(a, b);
+    // Combinación de boost::hash_combine y mezcla final de splitmix64 para repartir bien los bits altos
+    unsigned long long h = a ^ (b + 0x9e3779b97f4a7c15ULL + (a << 6) + (a >> 2));
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return (h >> 11) * (1.0 / 9007199254740992.0);
+}
+
+bool OverloadController::admitStats(const PacketInfo &info, size_t depth, size_t capacity, bool sheddable) {
+    double pressure = config.queuePressure && capacity > 0 ? (double) depth / capacity : 0;
+    if (config.maxLag > 0) {
+        // Retraso: tiempo de reloj transcurrido menos tiempo transcurrido según las marcas de los paquetes
+        Clock::time_point now = Clock::now();
+        if (!started) {
+            started = true;
+            wallStart = now;
+            packetStart = info.time;
+        }
+        double lag = std::chrono::duration<double>(now - wallStart).count() - (info.time - packetStart);
+        if (lag > peakLag.load(std::memory_order_relaxed))peakLag.store(lag, std::memory_order_relaxed);
+        lagPressure.store(lag / config.maxLag, std::memory_order_relaxed);
+        pressure = std::max(pressure, lag / config.maxLag);
+    }
+    statPressure += config.smoothing * (pressure - statPressure);
+    // El umbral solo sube o baja cuando la proporción deseada se aleja un escalón entero (histéresis)
+    double rate = shedRate(statPressure, config.statStart, config.statMaxShed);
+    if (rate >= statThreshold + config.statStep)statThreshold = std::floor(rate / config.statStep) * config.statStep;
+    else if (rate <= statThreshold - config.statStep)statThreshold = std::ceil(rate / config.statStep) * config.statStep;
+    statPressureNow.store(statPressure, std::memory_order_relaxed);
+    statRate.store(statThreshold, std::memory_order_relaxed);
+    packets.fetch_add(1, std::memory_order_relaxed);
+
+    if (sheddable && statThreshold > 0 && flowHash(info) < statThreshold) {
+        statShed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+bool OverloadController::admitScore(size_t depth, size_t capacity) {
+    double pressure = config.queuePressure && capacity > 0 ? (double) depth / capacity : 0;
+    pressure = std::max(pressure, lagPressure.load(std::memory_order_relaxed));
+    scorePressure += config.smoothing * (pressure - scorePressure);
+    double rate = shedRate(scorePressure, config.scoreStart, config.scoreMaxShed);
+    scorePressureNow.store(scorePressure, std::memory_order_relaxed);
+    scoreRate.store(rate, std::memory_order_relaxed);
+    scorable.fetch_add(1, std::memory_order_relaxed);
+
+    // Muestreo determinista: el descarte se acumula y se descarta un vector cada vez que suma uno entero
+    scoreCredit += rate;
+    if (scoreCredit >= 1) {
+        scoreCredit -= 1;
+        scoreShed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+OverloadMetrics OverloadController::getMetrics() const {
+    OverloadMetrics m;
+    m.packets = packets.load(std::memory_order_relaxed);
+    m.statShed = statShed.load(std::memory_order_relaxed);
+    m.scorable = scorable.load(std::memory_order_relaxed);
+    m.scoreShed = scoreShed.load(std::memory_order_relaxed);
+    m.statRate = statRate.load(std::memory_order_relaxed);
+    m.scoreRate = scoreRate.load(std::memory_order_relaxed);
+    m.statPressure = statPressureNow.load(std::memory_order_relaxed);
+    m.scorePressure = scorePressureNow.load(std::memory_order_relaxed);
+    m.peakLag = peakLag.load(std::memory_order_relaxed);
+    return m;
+}
+
+void OverloadController::printMetrics(FILE *fp) const {
+    OverloadMetrics m = getMetrics();
+    fprintf(fp, "kitsune_overload_packets_total %lld\n", m.packets);
+    fprintf(fp, "kitsune_overload_stat_shed_total %lld\n", m.statShed);
+    fprintf(fp, "kitsune_overload_scorable_total %lld\n", m.scorable);
+    fprintf(fp, "kitsune_overload_score_shed_total %lld\n", m.scoreShed);
+    fprintf(fp, "kitsune_overload_stat_shed_rate %.6f\n", m.statRate);
+    fprintf(fp, "kitsune_overload_score_shed_rate %.6f\n", m.scoreRate);
+    fprintf(fp, "kitsune_overload_stat_pressure %.6f\n", m.statPressure);
+    fprintf(fp, "kitsune_overload_score_pressure %.6f\n", m.scorePressure);
+    fprintf(fp, "kitsune_overload_peak_lag_seconds %.6f\n", m.peakLag);
+}
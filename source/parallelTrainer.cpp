@@ -0,0 +1,120 @@
+//
+// Entrenamiento fuera de línea de KitNET con paralelismo de datos y promediado de pesos.
+//
+
+#include <algorithm>
+#include "../include/parallelTrainer.h"
+
+
+// Secciones de parámetros de un modelo: las que se promedian y las de normalización
+struct ModelSections {
+    std::vector<std::pair<double *, size_t> > averaged, minimum, maximum;
+
+    explicit ModelSections(KitNET &model) {
+        PackedEnsemble *ensemble = model.getEnsembleLayer();
+        AE<KitNETActivation> *output = model.getOutputLayer();
+        size_t v = output->visibleSize(), h = output->hiddenSize();
+        // En el bloque de la capa integrada los pesos y umbrales (encW | decW | encB | decB) preceden a min_v
+        averaged.emplace_back(ensemble->parameters(), ensemble->minValues() - ensemble->parameters());
+        averaged.emplace_back(output->getEncoder()->weights(), v * h);
+        averaged.emplace_back(output->getDecoder()->weights(), h * v);
+        averaged.emplace_back(output->getEncoder()->biases(), h);
+        averaged.emplace_back(output->getDecoder()->biases(), v);
+        minimum.emplace_back(ensemble->minValues(), ensemble->totalVisible());
+        minimum.emplace_back(output->minValues(), v);
+        maximum.emplace_back(ensemble->maxValues(), ensemble->totalVisible());
+        maximum.emplace_back(output->maxValues(), v);
+    }
+};
+
+ParallelTrainer::ParallelTrainer(int replicas, long long sync_interval, int spin)
+        : replicas(replicas), syncInterval(sync_interval), pool(replicas, spin) {
+    if (replicas < 1 || sync_interval < 1) {
+        fprintf(stderr, "KitNET: the number of replicas and the sync interval must be positive\n");
+        throw -1;
+    }
+}
+
+void ParallelTrainer::train(KitNET &model, const double *X, long long rows) {
+    int n = model.getInputSize();
+    // Fase de mapeo de características, en serie
+    long long r = 0;
+    for (; r < rows && !model.isInitialized(); ++r)model.train(X + (size_t) r * n);
+    if (r == rows)return;
+
+    // Réplicas con el mismo mapa y los mismos parámetros; la réplica 0 es el propio modelo
+    std::vector<KitNET *> models(replicas, &model);
+    for (int w = 1; w < replicas; ++w) {
+        models[w] = new KitNET(new std::vector<std::vector<int> >(*model.getFeatureMap()), model.getEnsembleVhRate(),
+                               model.getOutputVhRate(), model.getEnsembleLearningRate(),
+                               model.getOutputLearningRate());
+        models[w]->setBatchSize(model.getBatchSize());
+    }
+    std::vector<ModelSections> sections;
+    for (KitNET *m : models)sections.emplace_back(*m);
+    auto broadcast = [&]() {
+        for (int w = 1; w < replicas; ++w) {
+            for (size_t s = 0; s < sections[0].averaged.size(); ++s)
+                std::copy(sections[0].averaged[s].first, sections[0].averaged[s].first + sections[0].averaged[s].second,
+                          sections[w].averaged[s].first);
+            for (size_t s = 0; s < sections[0].minimum.size(); ++s) {
+                std::copy(sections[0].minimum[s].first, sections[0].minimum[s].first + sections[0].minimum[s].second,
+                          sections[w].minimum[s].first);
+                std::copy(sections[0].maximum[s].first, sections[0].maximum[s].first + sections[0].maximum[s].second,
+                          sections[w].maximum[s].first);
+            }
+        }
+    };
+    // Fusiona en el modelo las réplicas que han entrenado en la última ronda (los tramos pueden diferir en una muestra)
+    auto merge = [&](const std::vector<int> &active) {
+        double inv = 1.0 / active.size();
+        for (size_t s = 0; s < sections[0].averaged.size(); ++s) {
+            double *dst = sections[0].averaged[s].first;
+            size_t count = sections[0].averaged[s].second;
+            const double *first = sections[active[0]].averaged[s].first;
+            if (first != dst)std::copy(first, first + count, dst);
+            for (size_t a = 1; a < active.size(); ++a) {
+                const double *src = sections[active[a]].averaged[s].first;
+                for (size_t i = 0; i < count; ++i)dst[i] += src[i];
+            }
+            for (size_t i = 0; i < count; ++i)dst[i] *= inv;
+        }
+        for (size_t s = 0; s < sections[0].minimum.size(); ++s) {
+            double *lo = sections[0].minimum[s].first, *hi = sections[0].maximum[s].first;
+            size_t count = sections[0].minimum[s].second;
+            for (int w : active) {
+                const double *srcLo = sections[w].minimum[s].first, *srcHi = sections[w].maximum[s].first;
+                for (size_t i = 0; i < count; ++i) {
+                    lo[i] = std::min(lo[i], srcLo[i]);
+                    hi[i] = std::max(hi[i], srcHi[i]);
+                }
+            }
+        }
+    };
+    broadcast();
+
+    // Tramos contiguos del resto de la caché
+    std::vector<long long> begin(replicas + 1);
+    for (int w = 0; w <= replicas; ++w)begin[w] = r + (rows - r) * w / replicas;
+    std::vector<long long> next(begin.begin(), begin.end() - 1);
+    try {
+        std::vector<int> active;
+        while (true) {
+            active.clear();
+            for (int w = 0; w < replicas; ++w)
+                if (next[w] < begin[w + 1])active.push_back(w);
+            if (active.empty())break;
+            pool.run([&](int w) {
+                int count = (int) std::min(syncInterval, begin[w + 1] - next[w]);
+                if (count > 0)models[w]->train_batch(X + (size_t) next[w] * n, count);
+                next[w] += count;
+            });
+            merge(active);
+            broadcast();
+        }
+    } catch (...) {
+        for (int w = 1; w < replicas; ++w)delete models[w];
+        throw;
+    }
+    for (int w = 1; w < replicas; ++w)delete models[w];
+}
@@ -0,0 +1,166 @@
+//
+// Canal de procesamiento por etapas: decodificación -> NetStat -> KitNET, cada una en su hilo.
+//
+
+#include <thread>
+#include <chrono>
+#include <memory>
+#include "../include/pipeline.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+bool pinCurrentThread(int cpu) {
+    if (cpu < 0)return false;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+// Espera de una etapa con la cola vacía o llena: espera activa breve y después cede la CPU
+static inline void backoff(int &waited, int spin) {
+    if (++waited < spin)WorkerPool::relax();
+    else std::this_thread::yield();
+}
+
+Pipeline::Pipeline(FE *fe, KitNET *model, long long train_num, const PipelineConfig &config)
+        : fe(fe), model(model), trainNum(train_num), config(config), packets(config.ringCapacity),
+          vectors(config.ringCapacity, VectorSlot{0, std::vector<double>(fe->getVectorSize()), false, {}}),
+          decodeDone(false), featureDone(false) {}
+
+void Pipeline::decodeStage() {
+    pinCurrentThread(config.decodeCpu);
+    auto t0 = std::chrono::steady_clock::now();
+    while (true) {
+        PacketSlot *slot;
+        int waited = 0;
+        while ((slot = packets.claim()) == nullptr) {
+            if (waited == 0)++decodeStats.fullWaits;
+            backoff(waited, config.spin);
+        }
+        if (!fe->readPacket(slot->info))break;
+        slot->decoded = MicroBatcher::Clock::now();
+        packets.publish();
+        ++decodeStats.items;
+    }
+    decodeDone.store(true, std::memory_order_release);
+    decodeStats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+void Pipeline::featureStage() {
+    pinCurrentThread(config.featureCpu);
+    auto t0 = std::chrono::steady_clock::now();
+    double depth = 0;
+    while (true) {
+        PacketSlot *in;
+        int waited = 0;
+        while ((in = packets.front()) == nullptr) {
+            // La decodificación publica todos sus paquetes antes de marcar el final
+            if (decodeDone.load(std::memory_order_acquire) && packets.front() == nullptr)break;
+            if (waited == 0)++featureStats.emptyWaits;
+            backoff(waited, config.spin);
+        }
+        if (in == nullptr)break;
+        const PacketInfo *info = &in->info;
+        size_t d = packets.size();
+        depth += d;
+        featureStats.maxDepth = std::max(featureStats.maxDepth, d);
+
+        long long packet = featureStats.items++;
+        // Los paquetes de entrenamiento siempre actualizan NetStat: sus vectores son el conjunto de entrenamiento
+        if (config.overload && !config.overload->admitStats(*info, d, packets.capacity(), packet >= trainNum)) {
+            packets.release();
+            continue;
+        }
+
+        VectorSlot *slot;
+        waited = 0;
+        while ((slot = vectors.claim()) == nullptr) {
+            if (waited == 0)++featureStats.fullWaits;
+            backoff(waited, config.spin);
+        }
+        slot->packet = packet;
+        slot->decoded = in->decoded;
+        fe->computeVector(*info, slot->x.data());
+        slot->skip = config.sampler && packet >= trainNum && !config.sampler->admit(*info, slot->x.data());
+        packets.release();
+        vectors.publish();
+    }
+    featureDone.store(true, std::memory_order_release);
+    if (featureStats.items > 0)featureStats.meanDepth = depth / featureStats.items;
+    featureStats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+void Pipeline::scoreStage() {
+    pinCurrentThread(config.scoreCpu);
+    auto t0 = std::chrono::steady_clock::now();
+    double depth = 0;
+    std::unique_ptr<MicroBatcher> batcher;
+    if (config.microBatch) {
+        batcher.reset(new MicroBatcher(model, config.batch));
+        batcher->setScoreCallback([&](long long packet, double score, double) {
+            if (onScore)onScore(packet, score, false);
+        });
+    }
+    while (true) {
+        VectorSlot *slot;
+        int waited = 0;
+        while ((slot = vectors.front()) == nullptr) {
+            if (featureDone.load(std::memory_order_acquire) && vectors.front() == nullptr)break;
+            if (waited == 0)++scoreStats.emptyWaits;
+            if (batcher)batcher->poll();
+            backoff(waited, config.spin);
+        }
+        if (slot == nullptr)break;
+        size_t d = vectors.size();
+        depth += d;
+        scoreStats.maxDepth = std::max(scoreStats.maxDepth, d);
+
+        bool training = slot->packet < trainNum;
+        if (!training && (slot->skip || (config.overload && !config.overload->admitScore(d, vectors.capacity())))) {
+            vectors.release();
+            ++scoreStats.items;
+            continue;
+        }
+        if (!training && batcher)batcher->submit(slot->x.data(), slot->packet, slot->decoded);
+        else {
+            double score = training ? model->train(slot->x.data()) : model->execute(slot->x.data());
+            if (onScore)onScore(slot->packet, score, training);
+        }
+        vectors.release();
+        ++scoreStats.items;
+    }
+    if (batcher)batcher->flush();
+    if (scoreStats.items > 0)scoreStats.meanDepth = depth / scoreStats.items;
+    scoreStats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+long long Pipeline::run() {
+    decodeStats = featureStats = scoreStats = StageStats();
+    decodeDone.store(false);
+    featureDone.store(false);
+    std::thread decode(&Pipeline::decodeStage, this);
+    std::thread feature(&Pipeline::featureStage, this);
+    std::thread score(&Pipeline::scoreStage, this);
+    decode.join();
+    feature.join();
+    score.join();
+    return scoreStats.items;
+}
+
+void Pipeline::printStats(FILE *fp) const {
+    const char *names[] = {"decode", "feature", "score"};
+    const StageStats *stats[] = {&decodeStats, &featureStats, &scoreStats};
+    for (int s = 0; s < 3; ++s)
+        fprintf(fp, "%-8s %lld items, %.3f s, input depth mean %.1f max %zu, %lld empty waits, %lld full waits\n",
+                names[s], stats[s]->items, stats[s]->seconds, stats[s]->meanDepth, stats[s]->maxDepth,
+                stats[s]->emptyWaits, stats[s]->fullWaits);
+}
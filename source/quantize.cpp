@@ -0,0 +1,404 @@
+//
+// Inferencia cuantizada en int8 de un KitNET entrenado.
+//
+
+#include <algorithm>
+#include "../include/quantize.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+
+// Reconstrucción en double con la normalización congelada; guarda la entrada normalizada en xn, la capa oculta en y
+// y la reconstrucción en z. Devuelve el RMSE
+static double frozenReconstruct(AE<KitNETActivation> &ae, const double *x, double *xn, double *y, double *z) {
+    int v = ae.visibleSize(), h = ae.hiddenSize();
+    const double *min_v = ae.minValues(), *max_v = ae.maxValues();
+    for (int i = 0; i < v; ++i)xn[i] = (x[i] - min_v[i]) / (max_v[i] - min_v[i] + 1e-13);
+    Dense<KitNETActivation> *encoder = ae.getEncoder(), *decoder = ae.getDecoder();
+    denseForward(encoder->weights(), encoder->biases(), xn, y, v, h);
+    KitNETActivation::apply(y, h);
+    denseForward(decoder->weights(), decoder->biases(), y, z, h, v);
+    KitNETActivation::apply(z, v);
+    return RMSE(xn, z, v);
+}
+
+// Mayor valor absoluto de x
+static double absMax(const double *x, int n) {
+    double m = 0;
+    for (int i = 0; i < n; ++i)m = std::max(m, std::fabs(x[i]));
+    return m;
+}
+
+// Ejecuta model en double con la normalización congelada. Si inRange y hidRange no son nullptr actualiza el mayor
+// valor absoluto de la entrada normalizada y de la capa oculta de cada autocodificador (el último es la capa de salida)
+static double frozenScore(KitNET &model, const double *x, std::vector<double> *inRange, std::vector<double> *hidRange) {
+    PackedEnsemble *ensemble = model.getEnsembleLayer();
+    AE<KitNETActivation> *outputLayer = model.getOutputLayer();
+    int ae_num = ensemble->size();
+    const int *index = ensemble->features();
+    std::vector<double> outputInput(ae_num), in, xn, y, z;
+    for (int k = 0; k <= ae_num; ++k) {
+        AE<KitNETActivation> *ae = k < ae_num ? ensemble->layer(k) : outputLayer;
+        int v = ae->visibleSize(), h = ae->hiddenSize();
+        in.resize(v);
+        xn.resize(v);
+        z.resize(v);
+        y.resize(h);
+        if (k < ae_num) {
+            for (int j = 0; j < v; ++j)in[j] = x[index[ensemble->visibleOffset(k) + j]];
+        } else in.assign(outputInput.begin(), outputInput.end());
+        double rmse = frozenReconstruct(*ae, in.data(), xn.data(), y.data(), z.data());
+        if (inRange != nullptr) {
+            (*inRange)[k] = std::max((*inRange)[k], absMax(xn.data(), v));
+            (*hidRange)[k] = std::max((*hidRange)[k], absMax(y.data(), h));
+        }
+        if (k < ae_num)outputInput[k] = rmse;
+        else return rmse;
+    }
+    return 0;
+}
+
+
+// Redondeo al entero más cercano con el número mágico 1,5 * 2^23 (|x| < 2^22), sin saltos para que el bucle se
+// vectorice
+static inline int32_t roundFloat(float x) {
+    float t = x + 12582912.0f;
+    int32_t bits;
+    std::memcpy(&bits, &t, sizeof(bits));
+    return bits - 0x4B400000;
+}
+
+// Grado del polinomio de la sigmoide en float: el de KitNETActivation, como mucho 7, que ya alcanza la precisión de
+// float (error relativo ~5e-9); con la sigmoide exacta, 7
+template<class Activation>
+struct FloatSigmoidDegree {
+    static const int value = 7;
+};
+
+template<int Accuracy>
+struct FloatSigmoidDegree<FastSigmoidActivation<Accuracy> > {
+    static const int value = Accuracy < 7 ? Accuracy : 7;
+};
+
+// Sigmoide en float con la misma construcción que fastExp: 2^k en los bits del exponente y 2^f con el polinomio de
+// Taylor de grado Degree en forma de Horner. x debe estar en [-80, 80]
+template<int Degree>
+static inline float sigmoidFloat(float x) {
+    const float log2e = 1.44269504f, ln2 = 0.693147181f;
+    float t = -x * log2e;
+    float kd = t + 12582912.0f, k = kd - 12582912.0f;
+    float r = (t - k) * ln2, p = 1.0f;
+    for (int n = Degree; n >= 1; --n)p = 1.0f + r * (1.0f / n) * p;
+    int32_t bits;
+    std::memcpy(&bits, &kd, sizeof(bits));
+    bits = (bits - 0x4B400000 + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return 1.0f / (1.0f + p * scale);
+}
+
+// Aplica a n valores en su sitio la sigmoide de KitNETActivation; la saturación va en una pasada aparte para que las
+// dos se vectoricen
+static void sigmoidFloat(float *KITSUNE_RESTRICT v, int n) {
+    for (int i = 0; i < n; ++i)v[i] = v[i] < -80 ? -80 : (v[i] > 80 ? 80 : v[i]);
+    for (int i = 0; i < n; ++i)v[i] = sigmoidFloat<FloatSigmoidDegree<KitNETActivation>::value>(v[i]);
+}
+
+
+template<class Activation>
+QuantizedDense::QuantizedDense(Dense<Activation> &layer, double inputRange) {
+    n_in = layer.inSize();
+    n_out = layer.outSize();
+    pairs = (n_in + 1) / 2;
+    const double *w = layer.weights();
+    double m = absMax(w, n_in * n_out);
+    wScale = (float) (m > 0 ? m / 127 : 1);
+    inScale = (float) ((inputRange > 0 ? inputRange : 1) / 127);
+    // Los pesos de Dense están por entradas (w[i * n_out + o]); aquí cada salida tiene sus pesos por pares de
+    // entradas, con un cero en el último par si n_in es impar
+    W.assign((size_t) n_out * pairs * 2, 0);
+    for (int o = 0; o < n_out; ++o)
+        for (int i = 0; i < n_in; ++i)
+            W[(size_t) o * pairs * 2 + i] = (int8_t) std::lrint(w[i * n_out + o] / wScale);
+    bias.assign(layer.biases(), layer.biases() + n_out);
+}
+
+// Productos enteros de un bloque: acc[o * R + r] = suma de los pares de xq de la fila r por los pares de pesos de la
+// salida o. xq guarda las dos entradas de cada par juntas para cada fila (xq[(p * R + r) * 2 + {0, 1}]), así que una
+// carga contiene los pares de varias filas y se multiplica por el mismo par de pesos difundido a todos los carriles.
+// wide tiene los pesos int8 de W ampliados a un par de int16 por int32 (wide[o * pairs + p]), listos para difundir.
+// Rows > 0 fija el número de filas en tiempo de compilación (execute, una fila); con 0 se usa rows
+template<int Rows>
+static void pairDot(const int16_t *KITSUNE_RESTRICT xq, const int8_t *KITSUNE_RESTRICT W,
+                    const int32_t *KITSUNE_RESTRICT wide, int n_out, int pairs, int rows,
+                    int32_t *KITSUNE_RESTRICT acc) {
+    const int R = Rows > 0 ? Rows : rows;
+    for (int o = 0; o < n_out; ++o) {
+        const int8_t *w = W + (size_t) o * pairs * 2;
+        const int32_t *wp = wide + (size_t) o * pairs;
+        (void) wp; // Solo lo usan los núcleos SIMD
+        int32_t *out = acc + (size_t) o * R;
+        int r = 0;
+#if defined(__AVX2__)
+        for (; r + 8 <= R; r += 8) {
+            __m256i a = _mm256_setzero_si256();
+            for (int p = 0; p < pairs; ++p) {
+                __m256i x = _mm256_loadu_si256((const __m256i *) (xq + ((size_t) p * R + r) * 2));
+#if defined(__AVXVNNI__)
+                a = _mm256_dpwssd_avx_epi32(a, x, _mm256_set1_epi32(wp[p]));
+#else
+                a = _mm256_add_epi32(a, _mm256_madd_epi16(x, _mm256_set1_epi32(wp[p])));
+#endif
+            }
+            _mm256_storeu_si256((__m256i *) (out + r), a);
+        }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+        for (; r + 4 <= R; r += 4) {
+            __m128i a = _mm_setzero_si128();
+            for (int p = 0; p < pairs; ++p) {
+                __m128i x = _mm_loadu_si128((const __m128i *) (xq + ((size_t) p * R + r) * 2));
+                a = _mm_add_epi32(a, _mm_madd_epi16(x, _mm_set1_epi32(wp[p])));
+            }
+            _mm_storeu_si128((__m128i *) (out + r), a);
+        }
+#endif
+        for (; r < R; ++r) {
+            int32_t a = 0;
+            for (int p = 0; p < pairs; ++p) {
+                const int16_t *x = xq + ((size_t) p * R + r) * 2;
+                a += (int32_t) x[0] * w[2 * p] + (int32_t) x[1] * w[2 * p + 1];
+            }
+            out[r] = a;
+        }
+    }
+}
+
+// Propagación de QuantizedDense::forward con el número de filas fijo (Rows > 0) o variable (Rows = 0, se usa rows)
+template<int Rows>
+static void quantizedForward(const QuantizedDense &layer, const float *x, int rows, int16_t *KITSUNE_RESTRICT xq,
+                             int32_t *KITSUNE_RESTRICT wide, int32_t *KITSUNE_RESTRICT acc,
+                             float *KITSUNE_RESTRICT scale, float *KITSUNE_RESTRICT y) {
+    const int R = Rows > 0 ? Rows : rows, n_in = layer.n_in, n_out = layer.n_out, pairs = layer.pairs;
+    const float inScale = layer.inScale, wScale = layer.wScale;
+    const float *bias = layer.bias.data();
+    // Escala de cada fila y su inversa: la calibrada, o la de la propia fila si la supera. Con ella |x / escala| <= 127
+    float *KITSUNE_RESTRICT inv = scale + R;
+    for (int r = 0; r < R; ++r)scale[r] = 0;
+    for (int i = 0; i < n_in; ++i)
+        for (int r = 0; r < R; ++r) {
+            float a = std::fabs(x[(size_t) i * R + r]);
+            scale[r] = scale[r] > a ? scale[r] : a;
+        }
+    for (int r = 0; r < R; ++r) {
+        float s = scale[r] * (1.0f / 127);
+        scale[r] = s > inScale ? s : inScale;
+        inv[r] = 1 / scale[r];
+    }
+    // Cuantización por pares: las dos entradas de cada par de una fila quedan juntas
+    for (int p = 0; p < pairs; ++p) {
+        const float *x0 = x + (size_t) 2 * p * R, *x1 = x0 + R;
+        int16_t *q = xq + (size_t) p * R * 2;
+        if (2 * p + 1 < n_in) {
+            for (int r = 0; r < R; ++r) {
+                q[2 * r] = (int16_t) roundFloat(x0[r] * inv[r]);
+                q[2 * r + 1] = (int16_t) roundFloat(x1[r] * inv[r]);
+            }
+        } else {
+            for (int r = 0; r < R; ++r) {
+                q[2 * r] = (int16_t) roundFloat(x0[r] * inv[r]);
+                q[2 * r + 1] = 0;
+            }
+        }
+    }
+    // Los núcleos SIMD (lotes de 4 filas o más) difunden cada par de pesos ampliado a dos int16 en un int32
+    const int8_t *W = layer.W.data();
+    if (R >= 4)
+        for (int i = 0; i < n_out * pairs; ++i)
+            wide[i] = (int32_t) ((uint32_t) (uint16_t) W[2 * i] | (uint32_t) (uint16_t) W[2 * i + 1] << 16);
+    pairDot<Rows>(xq, W, wide, n_out, pairs, R, acc);
+    for (int r = 0; r < R; ++r)scale[r] *= wScale;
+    for (int o = 0; o < n_out; ++o) {
+        float b = bias[o];
+        const int32_t *a = acc + (size_t) o * R;
+        float *out = y + (size_t) o * R;
+        for (int r = 0; r < R; ++r)out[r] = a[r] * scale[r] + b;
+    }
+}
+
+void QuantizedDense::forward(const float *x, int R, int16_t *KITSUNE_RESTRICT xq, int32_t *KITSUNE_RESTRICT wide,
+                             int32_t *KITSUNE_RESTRICT acc, float *KITSUNE_RESTRICT scale,
+                             float *KITSUNE_RESTRICT y) const {
+    // Una sola fila (execute): con el número de filas constante los bucles sobre las filas desaparecen
+    if (R == 1)quantizedForward<1>(*this, x, R, xq, wide, acc, scale, y);
+    else quantizedForward<0>(*this, x, R, xq, wide, acc, scale, y);
+}
+
+
+QuantizedAE::QuantizedAE(AE<KitNETActivation> &ae, double inputRange, double hiddenRange)
+        : v(ae.visibleSize()), h(ae.hiddenSize()), encoder(*ae.getEncoder(), inputRange),
+          decoder(*ae.getDecoder(), hiddenRange) {
+    min_v.assign(ae.minValues(), ae.minValues() + v);
+    scale_v.resize(v);
+    for (int i = 0; i < v; ++i)scale_v[i] = 1 / (ae.maxValues()[i] - min_v[i] + 1e-13);
+}
+
+
+void QuantizationReport::print(FILE *out) const {
+    fprintf(out, "Quantization report: %d samples, mean abs error %g, max abs error %g, mean rel error %g, "
+                 "correlation %.6f\n", samples, meanAbsError, maxAbsError, meanRelError, correlation);
+}
+
+
+const int QuantizedKitNET::BlockRows;
+
+QuantizedKitNET::QuantizedKitNET(KitNET &model, const double *X, int rows) {
+    if (!model.isInitialized()) {
+        fprintf(stderr, "KitNET: only a trained model can be quantized\n");
+        throw -1;
+    }
+    if (rows <= 0) {
+        fprintf(stderr, "KitNET: quantization needs at least one calibration vector\n");
+        throw -1;
+    }
+    inputSize = model.getInputSize();
+    PackedEnsemble *ensembleLayer = model.getEnsembleLayer();
+    int ae_num = ensembleLayer->size();
+    featureIndex.assign(ensembleLayer->features(), ensembleLayer->features() + ensembleLayer->totalVisible());
+    vOffset.resize(ae_num + 1);
+    for (int k = 0; k <= ae_num; ++k)
+        vOffset[k] = k < ae_num ? ensembleLayer->visibleOffset(k) : ensembleLayer->totalVisible();
+
+    // Calibración: rango de la entrada normalizada y de la capa oculta de cada autocodificador
+    std::vector<double> inRange(ae_num + 1, 0), hidRange(ae_num + 1, 0);
+    for (int r = 0; r < rows; ++r)frozenScore(model, X + (size_t) r * inputSize, &inRange, &hidRange);
+
+    ensemble.reserve(ae_num);
+    for (int k = 0; k < ae_num; ++k)ensemble.emplace_back(*ensembleLayer->layer(k), inRange[k], hidRange[k]);
+    output = new QuantizedAE(*model.getOutputLayer(), inRange[ae_num], hidRange[ae_num]);
+
+    // Normalización congelada aplanada
+    normMin.resize(featureIndex.size());
+    normScale.resize(featureIndex.size());
+    int maxWidth = output->v, maxPairs = output->encoder.pairs;
+    for (int k = 0; k < ae_num; ++k) {
+        std::copy(ensemble[k].min_v.begin(), ensemble[k].min_v.end(), normMin.begin() + vOffset[k]);
+        std::copy(ensemble[k].scale_v.begin(), ensemble[k].scale_v.end(), normScale.begin() + vOffset[k]);
+        maxWidth = std::max(maxWidth, std::max(ensemble[k].v, ensemble[k].h));
+        maxPairs = std::max(maxPairs, std::max(ensemble[k].encoder.pairs, ensemble[k].decoder.pairs));
+    }
+    maxWidth = std::max(maxWidth, output->h);
+    maxPairs = std::max(maxPairs, output->decoder.pairs);
+
+    // Variables temporales de un bloque
+    sx.resize(featureIndex.size() * BlockRows);
+    sy.resize((size_t) maxWidth * BlockRows);
+    sz.resize((size_t) maxWidth * BlockRows);
+    so.resize((size_t) output->v * BlockRows);
+    sr.resize(BlockRows);
+    ss.resize(2 * BlockRows);
+    sq.resize((size_t) maxPairs * 2 * BlockRows);
+    sa.resize((size_t) maxWidth * BlockRows);
+    sw.resize((size_t) maxWidth * maxPairs);
+}
+
+QuantizedKitNET::~QuantizedKitNET() {
+    delete output;
+}
+
+// Reconstrucción de QuantizedKitNET::reconstruct con el número de filas fijo (Rows > 0) o variable (Rows = 0)
+template<int Rows>
+static void quantizedReconstruct(const QuantizedAE &ae, const float *x, int rows, int16_t *xq, int32_t *wide,
+                                 int32_t *acc, float *scale, float *KITSUNE_RESTRICT y, float *KITSUNE_RESTRICT z,
+                                 float *KITSUNE_RESTRICT rmse) {
+    const int R = Rows > 0 ? Rows : rows;
+    quantizedForward<Rows>(ae.encoder, x, R, xq, wide, acc, scale, y);
+    sigmoidFloat(y, ae.h * R);
+    quantizedForward<Rows>(ae.decoder, y, R, xq, wide, acc, scale, z);
+    sigmoidFloat(z, ae.v * R);
+    for (int r = 0; r < R; ++r)rmse[r] = 0;
+    for (int i = 0; i < ae.v; ++i)
+        for (int r = 0; r < R; ++r) {
+            float d = x[(size_t) i * R + r] - z[(size_t) i * R + r];
+            rmse[r] += d * d;
+        }
+    for (int r = 0; r < R; ++r)rmse[r] = std::sqrt(rmse[r] / ae.v);
+}
+
+void QuantizedKitNET::reconstruct(const QuantizedAE &ae, const float *x, int R, float *rmse) {
+    int16_t *xq = sq.data();
+    int32_t *wide = sw.data(), *acc = sa.data();
+    if (R == 1)quantizedReconstruct<1>(ae, x, R, xq, wide, acc, ss.data(), sy.data(), sz.data(), rmse);
+    else quantizedReconstruct<0>(ae, x, R, xq, wide, acc, ss.data(), sy.data(), sz.data(), rmse);
+}
+
+void QuantizedKitNET::executeBlock(const double *X, int rows, double *result) {
+    int R = rows, visible = featureIndex.size();
+    float *xn = sx.data(), *o = so.data();
+    // Reunir y normalizar, trasponiendo a una fila de R valores por posición visible
+    for (int r = 0; r < R; ++r) {
+        const double *x = X + (size_t) r * inputSize;
+        for (int i = 0; i < visible; ++i)
+            xn[(size_t) i * R + r] = (float) ((x[featureIndex[i]] - normMin[i]) * normScale[i]);
+    }
+    int ae_num = ensemble.size();
+    for (int k = 0; k < ae_num; ++k)reconstruct(ensemble[k], xn + (size_t) vOffset[k] * R, R, o + (size_t) k * R);
+
+    // Capa de salida
+    const QuantizedAE &out = *output;
+    for (int i = 0; i < out.v; ++i) {
+        float m = (float) out.min_v[i], s = (float) out.scale_v[i];
+        float *oi = o + (size_t) i * R;
+        for (int r = 0; r < R; ++r)oi[r] = (oi[r] - m) * s;
+    }
+    reconstruct(out, o, R, sr.data());
+    for (int r = 0; r < R; ++r)result[r] = sr[r];
+}
+
+double QuantizedKitNET::execute(const double *x) {
+    double result;
+    executeBlock(x, 1, &result);
+    return result;
+}
+
+void QuantizedKitNET::execute_batch(const double *X, int rows, double *result) {
+    for (int r = 0; r < rows; r += BlockRows)
+        executeBlock(X + (size_t) r * inputSize, std::min(BlockRows, rows - r), result + r);
+}
+
+size_t QuantizedKitNET::bytes() const {
+    size_t total = output->bytes() + featureIndex.size() * (sizeof(int) + 2 * sizeof(double));
+    for (auto &ae : ensemble)total += ae.bytes();
+    return total;
+}
+
+QuantizationReport QuantizedKitNET::compare(KitNET &model, const double *X, int rows) {
+    QuantizationReport report;
+    std::vector<double> scores(std::max(rows, 0));
+    execute_batch(X, rows, scores.data());
+    double sumRef = 0, sumQ = 0, sumRef2 = 0, sumQ2 = 0, sumRefQ = 0;
+    for (int r = 0; r < rows; ++r) {
+        const double *x = X + (size_t) r * inputSize;
+        double ref = frozenScore(model, x, nullptr, nullptr), q = scores[r];
+        double err = std::fabs(q - ref);
+        report.meanAbsError += err;
+        report.maxAbsError = std::max(report.maxAbsError, err);
+        report.meanRelError += err / std::max(std::fabs(ref), 1e-12);
+        sumRef += ref;
+        sumQ += q;
+        sumRef2 += ref * ref;
+        sumQ2 += q * q;
+        sumRefQ += ref * q;
+    }
+    report.samples = rows;
+    if (rows > 0) {
+        report.meanAbsError /= rows;
+        report.meanRelError /= rows;
+        double cov = sumRefQ - sumRef * sumQ / rows;
+        double varRef = sumRef2 - sumRef * sumRef / rows, varQ = sumQ2 - sumQ * sumQ / rows;
+        report.correlation = varRef > 0 && varQ > 0 ? cov / std::sqrt(varRef * varQ) : 0;
+    }
+    return report;
+}
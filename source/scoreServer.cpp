@@ -0,0 +1,457 @@
+//
+// Servicio local de puntuación sobre un socket de dominio Unix, con peticiones por lotes.
+//
+
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include "../include/scoreServer.h"
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+
+void encodePacketRecord(const PacketInfo &info, std::string &out) {
+    out.append((const char *) &info.time, sizeof(double));
+    out.append((const char *) &info.size, sizeof(double));
+    const std::string *fields[] = {&info.srcMAC, &info.dstMAC, &info.srcIP, &info.srcPort, &info.dstIP, &info.dstPort};
+    for (const std::string *field : fields) {
+        size_t len = std::min<size_t>(field->size(), 255);
+        out.push_back((char) len);
+        out.append(field->data(), len);
+    }
+}
+
+bool decodePacketRecord(const char *&p, const char *end, PacketInfo &info) {
+    if (end - p < (ptrdiff_t) (2 * sizeof(double)))return false;
+    memcpy(&info.time, p, sizeof(double));
+    memcpy(&info.size, p + sizeof(double), sizeof(double));
+    p += 2 * sizeof(double);
+    std::string *fields[] = {&info.srcMAC, &info.dstMAC, &info.srcIP, &info.srcPort, &info.dstIP, &info.dstPort};
+    for (std::string *field : fields) {
+        if (p >= end)return false;
+        size_t len = (unsigned char) *p++;
+        if ((size_t) (end - p) < len)return false;
+        field->assign(p, len);
+        p += len;
+    }
+    return true;
+}
+
+
+#if defined(__linux__)
+
+// Dirección de un socket de dominio Unix
+static bool unixAddress(const std::string &path, sockaddr_un &addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))return false;
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+ScoreServer::ScoreServer(KitNET *model, const std::string &path)
+        : model(model), path(path), n(model->getInputSize()) {
+    NetStat probe;
+    if (probe.getVectorSize() == n)netStat = new NetStat();
+    stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (stopFd < 0) {
+        fprintf(stderr, "KitNET: cannot create the server event descriptor\n");
+        throw -1;
+    }
+}
+
+ScoreServer::~ScoreServer() {
+    for (auto &c : connections) {
+        ::close(c.first);
+        delete c.second;
+    }
+    if (listenFd >= 0) {
+        ::close(listenFd);
+        unlink(path.c_str());
+    }
+    if (epollFd >= 0)::close(epollFd);
+    if (stopFd >= 0)::close(stopFd);
+    delete netStat;
+}
+
+void ScoreServer::stop() {
+    uint64_t one = 1;
+    ssize_t r = write(stopFd, &one, sizeof(one));
+    (void) r;
+}
+
+void ScoreServer::run() {
+    sockaddr_un addr;
+    if (!unixAddress(path, addr)) {
+        fprintf(stderr, "KitNET: socket path too long: %s\n", path.c_str());
+        throw -1;
+    }
+    unlink(path.c_str());
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0 || bind(listenFd, (sockaddr *) &addr, sizeof(addr)) < 0 || listen(listenFd, SOMAXCONN) < 0) {
+        fprintf(stderr, "KitNET: cannot listen on %s: %s\n", path.c_str(), strerror(errno));
+        throw -1;
+    }
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = listenFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+    ev.data.fd = stopFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, stopFd, &ev);
+
+    const int MaxEvents = 256;
+    epoll_event events[MaxEvents];
+    std::vector<Connection *> closing;
+    bool running = true;
+    while (running) {
+        int ready = epoll_wait(epollFd, events, MaxEvents, -1);
+        if (ready < 0) {
+            if (errno == EINTR)continue;
+            fprintf(stderr, "KitNET: epoll_wait failed: %s\n", strerror(errno));
+            throw -1;
+        }
+        for (int e = 0; e < ready; ++e) {
+            int fd = events[e].data.fd;
+            if (fd == listenFd) {
+                acceptAll();
+                continue;
+            }
+            if (fd == stopFd) {
+                running = false;
+                continue;
+            }
+            auto found = connections.find(fd);
+            if (found == connections.end())continue;
+            Connection *conn = found->second;
+            if (conn->closed)continue;
+            bool ok = !(events[e].events & EPOLLERR);
+            if (ok && (events[e].events & EPOLLOUT))ok = writeTo(conn);
+            if (ok && !conn->readClosed && (events[e].events & (EPOLLIN | EPOLLHUP)))ok = readFrom(conn);
+            if (!ok) {
+                conn->closed = true;
+                closing.push_back(conn);
+            }
+        }
+
+        // Un solo lote con las peticiones de todos los clientes de esta vuelta
+        scoreBatch();
+        for (auto &c : connections) {
+            Connection *conn = c.second;
+            if (conn->closed)continue;
+            // Tras un cierre de escritura del cliente la conexión se cierra cuando ya no queda nada por enviar
+            if ((conn->outPos < conn->out.size() && !writeTo(conn)) ||
+                (conn->readClosed && conn->outPos == conn->out.size())) {
+                conn->closed = true;
+                closing.push_back(conn);
+            } else watch(conn);
+        }
+        for (Connection *conn : closing)close(conn);
+        closing.clear();
+    }
+    uint64_t value;
+    ssize_t r = read(stopFd, &value, sizeof(value));
+    (void) r;
+}
+
+void ScoreServer::acceptAll() {
+    while (true) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)return;
+        Connection *conn = new Connection();
+        conn->fd = fd;
+        connections[fd] = conn;
+        ++accepted;
+        watch(conn);
+    }
+}
+
+void ScoreServer::watch(Connection *conn) {
+    size_t unsent = conn->out.size() - conn->outPos;
+    bool readable = !conn->readClosed && unsent < MaxOutput;
+    unsigned events = (readable ? (unsigned) EPOLLIN : 0) | (unsent > 0 ? (unsigned) EPOLLOUT : 0);
+    if (events == conn->events)return;
+    epoll_event ev;
+    ev.events = events;
+    ev.data.fd = conn->fd;
+    epoll_ctl(epollFd, conn->events == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, conn->fd, &ev);
+    conn->events = events;
+}
+
+void ScoreServer::close(Connection *conn) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, conn->fd, nullptr);
+    ::close(conn->fd);
+    connections.erase(conn->fd);
+    delete conn;
+}
+
+bool ScoreServer::readFrom(Connection *conn) {
+    char buffer[65536];
+    bool open = true;
+    while (true) {
+        ssize_t got = read(conn->fd, buffer, sizeof(buffer));
+        if (got > 0) {
+            conn->in.insert(conn->in.end(), buffer, buffer + got);
+            continue;
+        }
+        // Fin de la entrada: se responden los mensajes ya recibidos y se deja de leer (ver run)
+        if (got == 0)conn->readClosed = true;
+        else if (errno == EINTR)continue;
+        else if (errno != EAGAIN && errno != EWOULDBLOCK)open = false;
+        break;
+    }
+
+    // Mensajes completos
+    while (conn->in.size() - conn->inPos >= sizeof(ScoreFrame)) {
+        ScoreFrame frame;
+        memcpy(&frame, conn->in.data() + conn->inPos, sizeof(frame));
+        if (frame.length > MaxFrame) {
+            const char message[] = "frame too large";
+            reply(conn, ScoreError, frame.id, 0, message, sizeof(message) - 1);
+            ++errors;
+            writeTo(conn);
+            return false;
+        }
+        if (conn->in.size() - conn->inPos < sizeof(ScoreFrame) + frame.length)break;
+        const char *payload = conn->in.data() + conn->inPos + sizeof(ScoreFrame);
+        conn->inPos += sizeof(ScoreFrame) + frame.length;
+        ++requests;
+        if (!handle(conn, frame, payload))return false;
+    }
+    // Compacta el búfer de entrada
+    if (conn->inPos == conn->in.size()) {
+        conn->in.clear();
+        conn->inPos = 0;
+    } else if (conn->inPos > 65536) {
+        conn->in.erase(conn->in.begin(), conn->in.begin() + conn->inPos);
+        conn->inPos = 0;
+    }
+    return open;
+}
+
+bool ScoreServer::handle(Connection *conn, const ScoreFrame &frame, const char *payload) {
+    const char *error = nullptr;
+    switch (frame.type) {
+        case ScoreInfo: {
+            uint32_t size = n;
+            pending.push_back(Pending{conn, frame.id, nextRow(), 0, ScoreInfoReply, std::string((char *) &size, sizeof(size))});
+            return true;
+        }
+        case ScoreVectors: {
+            if (frame.count > MaxRows) {
+                error = "too many vectors in one request";
+                break;
+            }
+            if ((uint64_t) frame.count * n * sizeof(double) != frame.length) {
+                error = "vector payload does not match count x input size";
+                break;
+            }
+            size_t row = nextRow();
+            X.resize((row + frame.count) * n);
+            memcpy(X.data() + row * n, payload, frame.length);
+            pending.push_back(Pending{conn, frame.id, row, frame.count, ScoreResult, std::string()});
+            return true;
+        }
+        case ScorePackets: {
+            if (netStat == nullptr) {
+                error = "model input size does not match NetStat vectors";
+                break;
+            }
+            if (frame.count > MaxRows) {
+                error = "too many packets in one request";
+                break;
+            }
+            size_t row = nextRow();
+            // Se comprueba todo el mensaje antes de actualizar NetStat con ninguno de sus paquetes
+            const char *p = payload, *end = payload + frame.length;
+            PacketInfo info;
+            uint32_t valid = 0;
+            while (valid < frame.count && decodePacketRecord(p, end, info))++valid;
+            if (valid != frame.count || p != end) {
+                error = "malformed packet records";
+                break;
+            }
+            X.resize((row + frame.count) * n);
+            p = payload;
+            for (uint32_t i = 0; i < frame.count; ++i) {
+                decodePacketRecord(p, end, info);
+                netStat->updateAndGetStats(info.srcMAC, info.dstMAC, info.srcIP, info.srcPort, info.dstIP,
+                                           info.dstPort, info.size, info.time, X.data() + (row + i) * n);
+            }
+            pending.push_back(Pending{conn, frame.id, row, frame.count, ScoreResult, std::string()});
+            return true;
+        }
+        default:
+            error = "unknown request type";
+    }
+    ++errors;
+    pending.push_back(Pending{conn, frame.id, nextRow(), 0, ScoreError, std::string(error)});
+    return true;
+}
+
+void ScoreServer::scoreBatch() {
+    if (pending.empty())return;
+    size_t total = nextRow();
+    scores.resize(total);
+    if (total > 0) {
+        model->execute_batch(X.data(), (int) total, scores.data());
+        ++batches;
+        rows += total;
+    }
+    for (const Pending &p : pending) {
+        if (p.conn->closed)continue;
+        if (p.type == ScoreResult)
+            reply(p.conn, ScoreResult, p.id, p.count, scores.data() + p.row, p.count * sizeof(double));
+        else reply(p.conn, p.type, p.id, 0, p.payload.data(), p.payload.size());
+    }
+    pending.clear();
+}
+
+void ScoreServer::reply(Connection *conn, uint16_t type, uint32_t id, uint32_t count, const void *payload,
+                        size_t length) {
+    ScoreFrame frame{(uint32_t) length, type, 0, id, count};
+    if (conn->outPos == conn->out.size()) {
+        conn->out.clear();
+        conn->outPos = 0;
+    }
+    conn->out.append((const char *) &frame, sizeof(frame));
+    conn->out.append((const char *) payload, length);
+}
+
+bool ScoreServer::writeTo(Connection *conn) {
+    while (conn->outPos < conn->out.size()) {
+        ssize_t sent = send(conn->fd, conn->out.data() + conn->outPos, conn->out.size() - conn->outPos, MSG_NOSIGNAL);
+        if (sent > 0) {
+            conn->outPos += sent;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR)continue;
+        return sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+    conn->out.clear();
+    conn->outPos = 0;
+    return true;
+}
+
+
+ScoreClient::ScoreClient(const std::string &path) {
+    sockaddr_un addr;
+    if (!unixAddress(path, addr)) {
+        fprintf(stderr, "KitNET: socket path too long: %s\n", path.c_str());
+        throw -1;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (sockaddr *) &addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "KitNET: cannot connect to %s: %s\n", path.c_str(), strerror(errno));
+        if (fd >= 0)::close(fd);
+        throw -1;
+    }
+}
+
+ScoreClient::~ScoreClient() {
+    if (fd >= 0)::close(fd);
+}
+
+ScoreFrame ScoreClient::request(uint16_t type, uint32_t count, const void *data, size_t length) {
+    ScoreFrame header{(uint32_t) length, type, 0, nextId++, count};
+    frame.assign((const char *) &header, sizeof(header));
+    frame.append((const char *) data, length);
+    for (size_t done = 0; done < frame.size();) {
+        ssize_t sent = send(fd, frame.data() + done, frame.size() - done, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)continue;
+        if (sent <= 0) {
+            fprintf(stderr, "KitNET: scoring request failed: %s\n", strerror(errno));
+            throw -1;
+        }
+        done += sent;
+    }
+
+    ScoreFrame answer;
+    auto receive = [&](void *to, size_t size) {
+        for (size_t done = 0; done < size;) {
+            ssize_t got = recv(fd, (char *) to + done, size - done, 0);
+            if (got < 0 && errno == EINTR)continue;
+            if (got <= 0) {
+                fprintf(stderr, "KitNET: scoring server closed the connection\n");
+                throw -1;
+            }
+            done += got;
+        }
+    };
+    receive(&answer, sizeof(answer));
+    payload.resize(answer.length);
+    receive(payload.data(), answer.length);
+    if (answer.id != header.id) {
+        fprintf(stderr, "KitNET: scoring reply out of order\n");
+        throw -1;
+    }
+    if (answer.type == ScoreError) {
+        fprintf(stderr, "KitNET: scoring server error: %.*s\n", (int) payload.size(), payload.data());
+        throw -1;
+    }
+    return answer;
+}
+
+int ScoreClient::vectorSize() {
+    request(ScoreInfo, 0, nullptr, 0);
+    uint32_t size;
+    memcpy(&size, payload.data(), sizeof(size));
+    return size;
+}
+
+void ScoreClient::scoreVectors(const double *X, int rows, int n, double *result) {
+    // Trozos de como mucho MaxRows vectores y MaxFrame bytes
+    size_t fit = ScoreServer::MaxFrame / (n * sizeof(double));
+    int chunk = (int) std::max<size_t>(1, std::min<size_t>(ScoreServer::MaxRows, fit));
+    for (int r = 0; r < rows; r += chunk) {
+        int count = std::min(chunk, rows - r);
+        ScoreFrame answer = request(ScoreVectors, count, X + (size_t) r * n, (size_t) count * n * sizeof(double));
+        memcpy(result + r, payload.data(), (size_t) answer.count * sizeof(double));
+    }
+}
+
+void ScoreClient::scorePackets(const std::vector<PacketInfo> &packets, double *result) {
+    std::string records;
+    for (size_t i = 0; i < packets.size(); i += ScoreServer::MaxRows) {
+        size_t count = std::min<size_t>(ScoreServer::MaxRows, packets.size() - i);
+        records.clear();
+        for (size_t j = i; j < i + count; ++j)encodePacketRecord(packets[j], records);
+        ScoreFrame answer = request(ScorePackets, count, records.data(), records.size());
+        memcpy(result + i, payload.data(), (size_t) answer.count * sizeof(double));
+    }
+}
+
+#else
+
+ScoreServer::ScoreServer(KitNET *model, const std::string &path) : model(model), path(path), n(0) {
+    fprintf(stderr, "KitNET: the scoring server needs Linux (epoll)\n");
+    throw -1;
+}
+
+ScoreServer::~ScoreServer() {}
+
+void ScoreServer::run() {}
+
+void ScoreServer::stop() {}
+
+ScoreClient::ScoreClient(const std::string &path) {
+    fprintf(stderr, "KitNET: the scoring client needs Linux\n");
+    throw -1;
+}
+
+ScoreClient::~ScoreClient() {}
+
+int ScoreClient::vectorSize() { return 0; }
+
+void ScoreClient::scoreVectors(const double *X, int rows, int n, double *result) {}
+
+void ScoreClient::scorePackets(const std::vector<PacketInfo> &packets, double *result) {}
+
+#endif
@@ -0,0 +1,157 @@
+//
+// Enrutado de los vectores de instancia a un modelo KitNET por segmento de red.
+//
+
+#include <algorithm>
+#include <chrono>
+#include "../include/segmentRouter.h"
+
+
+bool PrefixTable::parseIPv4(const char *text, uint32_t &address) {
+    address = 0;
+    for (int part = 0; part < 4; ++part) {
+        if (*text < '0' || *text > '9')return false;
+        int value = 0;
+        for (int digits = 0; *text >= '0' && *text <= '9'; ++text) {
+            value = value * 10 + (*text - '0');
+            if (++digits > 3 || value > 255)return false;
+        }
+        address = address << 8 | value;
+        if (part < 3 && *text++ != '.')return false;
+    }
+    return *text == '\0';
+}
+
+void PrefixTable::add(const std::string &cidr, int target) {
+    size_t slash = cidr.find('/');
+    Prefix prefix;
+    prefix.length = 32;
+    prefix.target = target;
+    if (slash != std::string::npos) {
+        const char *len = cidr.c_str() + slash + 1;
+        char *end;
+        prefix.length = strtol(len, &end, 10);
+        if (end == len || *end != '\0' || prefix.length < 0 || prefix.length > 32) {
+            fprintf(stderr, "KitNET: invalid prefix length in %s\n", cidr.c_str());
+            throw -1;
+        }
+    }
+    if (!parseIPv4(cidr.substr(0, slash).c_str(), prefix.address)) {
+        fprintf(stderr, "KitNET: invalid IPv4 prefix %s\n", cidr.c_str());
+        throw -1;
+    }
+    if (prefix.length < 32)prefix.address &= prefix.length == 0 ? 0 : ~0u << (32 - prefix.length);
+    prefixes.push_back(prefix);
+}
+
+void PrefixTable::compile() {
+    // De más corto a más largo: cada prefijo sobrescribe a los que lo contienen y los nodos nuevos heredan el destino
+    // de la entrada de la que cuelgan. Un prefijo de longitud l solo crea nodos por debajo de los niveles que cubre
+    // entero, así que al rellenar sus entradas estas todavía no tienen hijos
+    std::stable_sort(prefixes.begin(), prefixes.end(),
+                     [](const Prefix &a, const Prefix &b) { return a.length < b.length; });
+    nodes.assign(256, Entry{defaultTarget, -1});
+    for (const Prefix &prefix : prefixes) {
+        size_t node = 0;
+        for (int level = 0;; ++level) {
+            int byte = (prefix.address >> (24 - 8 * level)) & 0xff;
+            if (prefix.length <= 8 * (level + 1)) {
+                int span = 1 << (8 * (level + 1) - prefix.length);
+                for (int i = byte; i < byte + span; ++i)nodes[node * 256 + i].target = prefix.target;
+                break;
+            }
+            Entry &e = nodes[node * 256 + byte];
+            if (e.child < 0) {
+                int inherited = e.target;
+                e.child = nodes.size() / 256;
+                nodes.resize(nodes.size() + 256, Entry{inherited, -1});
+            }
+            node = nodes[node * 256 + byte].child;
+        }
+    }
+}
+
+int PrefixTable::lookup(const std::string &address) const {
+    uint32_t value;
+    if (!parseIPv4(address.c_str(), value))return defaultTarget;
+    return lookup(value);
+}
+
+
+SegmentRouter::SegmentRouter(const PrefixTable &table, RouteKey key, int vector_size, size_t queue_capacity)
+        : table(table), key(key), vectorSize(vector_size), queueCapacity(queue_capacity), stop(false) {
+    this->table.compile();
+}
+
+SegmentRouter::~SegmentRouter() {
+    finish();
+    for (Segment *segment : segments) {
+        delete segment->model;
+        delete segment;
+    }
+}
+
+int SegmentRouter::addSegment(KitNET *model, long long train_num) {
+    if (started) {
+        fprintf(stderr, "KitNET: segments must be added before the router starts\n");
+        throw -1;
+    }
+    segments.push_back(new Segment(model, train_num, queueCapacity, vectorSize));
+    return segments.size() - 1;
+}
+
+void SegmentRouter::start() {
+    if (started)return;
+    started = true;
+    for (int id = 0; id < (int) segments.size(); ++id)
+        segments[id]->worker = std::thread(&SegmentRouter::segmentLoop, this, id);
+}
+
+void SegmentRouter::segmentLoop(int id) {
+    Segment &segment = *segments[id];
+    long long seen = 0;
+    int idle = 0;
+    while (true) {
+        Job *job = segment.queue.front();
+        if (job == nullptr) {
+            // Solo se termina con la cola vacía, así que finish no pierde vectores
+            if (stop.load(std::memory_order_acquire) && segment.queue.size() == 0)break;
+            if (++idle < 1000)WorkerPool::relax();
+            else std::this_thread::sleep_for(std::chrono::microseconds(50));
+            continue;
+        }
+        idle = 0;
+        bool training = seen++ < segment.trainNum;
+        double score = training ? segment.model->train(job->x.data()) : segment.model->execute(job->x.data());
+        if (onScore)onScore(id, job->packet, score, training);
+        segment.queue.release();
+        segment.processed.fetch_add(1, std::memory_order_release);
+    }
+}
+
+int SegmentRouter::dispatch(const double *x, const PacketInfo &info, long long packet) {
+    int id = route(info);
+    if (id < 0 || id >= (int) segments.size()) {
+        ++unrouted;
+        return -1;
+    }
+    if (stop.load(std::memory_order_relaxed)) {
+        fprintf(stderr, "KitNET: the segment router has already finished\n");
+        throw -1;
+    }
+    if (!started)start();
+    SPSCRing<Job> &queue = segments[id]->queue;
+    Job *job;
+    while ((job = queue.claim()) == nullptr)std::this_thread::yield();
+    job->packet = packet;
+    std::copy(x, x + vectorSize, job->x.begin());
+    queue.publish();
+    return id;
+}
+
+void SegmentRouter::finish() {
+    if (!started)return;
+    stop.store(true, std::memory_order_release);
+    for (Segment *segment : segments)
+        if (segment->worker.joinable())segment->worker.join();
+}
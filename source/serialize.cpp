@@ -0,0 +1,179 @@
+//
+// Lectura y escritura de ficheros binarios de modelos.
+//
+
+#include "../include/serialize.h"
+#include <algorithm>
+#include "../include/utils.h"
+
+#ifdef _WIN32
+#include <vector>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+BinaryWriter::BinaryWriter(const char *filename) {
+    fp = fopen(filename, "wb");
+    if (fp == nullptr) {
+        fprintf(stderr, "KitNET: cannot open %s for writing\n", filename);
+        throw -1;
+    }
+}
+
+BinaryWriter::~BinaryWriter() {
+    fclose(fp);
+}
+
+void BinaryWriter::bytes(const void *data, size_t n) {
+    if (n > 0 && fwrite(data, 1, n, fp) != n) {
+        fprintf(stderr, "KitNET: write error\n");
+        throw -1;
+    }
+    offset += n;
+}
+
+void BinaryWriter::u32(uint32_t v) {
+    unsigned char b[4];
+    for (int i = 0; i < 4; ++i)b[i] = (unsigned char) (v >> (8 * i));
+    bytes(b, 4);
+}
+
+void BinaryWriter::u64(uint64_t v) {
+    unsigned char b[8];
+    for (int i = 0; i < 8; ++i)b[i] = (unsigned char) (v >> (8 * i));
+    bytes(b, 8);
+}
+
+void BinaryWriter::f64(double v) {
+    uint64_t bits;
+    std::memcpy(&bits, &v, 8);
+    u64(bits);
+}
+
+void BinaryWriter::f64s(const double *v, size_t n) {
+    if (hostLittleEndian())bytes(v, n * sizeof(double));
+    else for (size_t i = 0; i < n; ++i)f64(v[i]);
+}
+
+void BinaryWriter::i32s(const int *v, size_t n) {
+    for (size_t i = 0; i < n; ++i)u32((uint32_t) v[i]);
+}
+
+void BinaryWriter::align(size_t alignment) {
+    static const unsigned char zeros[KitsuneAlignment] = {0};
+    while (offset % alignment != 0)bytes(zeros, std::min(alignment - offset % alignment, sizeof(zeros)));
+}
+
+
+void BinaryReader::need(size_t n) const {
+    if (n > size - offset) {
+        fprintf(stderr, "KitNET: truncated model file\n");
+        throw -1;
+    }
+}
+
+void BinaryReader::bytes(void *out, size_t n) {
+    need(n);
+    std::memcpy(out, data + offset, n);
+    offset += n;
+}
+
+uint32_t BinaryReader::u32() {
+    need(4);
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i)v |= (uint32_t) data[offset + i] << (8 * i);
+    offset += 4;
+    return v;
+}
+
+uint64_t BinaryReader::u64() {
+    need(8);
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i)v |= (uint64_t) data[offset + i] << (8 * i);
+    offset += 8;
+    return v;
+}
+
+double BinaryReader::f64() {
+    uint64_t bits = u64();
+    double v;
+    std::memcpy(&v, &bits, 8);
+    return v;
+}
+
+void BinaryReader::f64s(double *out, size_t n) {
+    if (hostLittleEndian())bytes(out, n * sizeof(double));
+    else for (size_t i = 0; i < n; ++i)out[i] = f64();
+}
+
+void BinaryReader::i32s(int *out, size_t n) {
+    for (size_t i = 0; i < n; ++i)out[i] = (int) u32();
+}
+
+void BinaryReader::align(size_t alignment) {
+    skip((alignment - offset % alignment) % alignment);
+}
+
+void BinaryReader::skip(size_t n) {
+    need(n);
+    offset += n;
+}
+
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const char *filename) {
+    FILE *fp = fopen(filename, "rb");
+    if (fp == nullptr) {
+        fprintf(stderr, "KitNET: cannot open %s\n", filename);
+        throw -1;
+    }
+    std::vector<unsigned char> content;
+    unsigned char chunk[1 << 16];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0)content.insert(content.end(), chunk, chunk + n);
+    fclose(fp);
+    length = content.size();
+    // Bloque alineado, igual que una proyección de memoria
+    base = (unsigned char *) alignedAlloc((length + sizeof(double) - 1) / sizeof(double));
+    std::memcpy(base, content.data(), length);
+}
+
+MappedFile::~MappedFile() {
+    alignedFree((double *) base);
+}
+
+#else
+
+MappedFile::MappedFile(const char *filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "KitNET: cannot open %s\n", filename);
+        throw -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        fprintf(stderr, "KitNET: cannot read %s\n", filename);
+        throw -1;
+    }
+    length = st.st_size;
+    // Copia en escritura: las escrituras (p. ej. la normalización de un modelo cargado) no llegan al fichero
+    void *p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "KitNET: cannot map %s\n", filename);
+        throw -1;
+    }
+    base = (unsigned char *) p;
+}
+
+MappedFile::~MappedFile() {
+    munmap(base, length);
+}
+
+#endif
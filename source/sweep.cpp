@@ -0,0 +1,132 @@
+//
+// Barrido de hiperparámetros de KitNET sobre un mismo flujo de vectores de características.
+//
+
+#include <cmath>
+#include <mutex>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include "../include/sweep.h"
+
+
+SweepEngine::SweepEngine(const double *X, long long rows, int n, int threads, int block_rows)
+        : X(X), rows(rows), n(n), blockRows(block_rows), pool(threads) {
+    if (block_rows < 1) {
+        fprintf(stderr, "KitNET: the sweep block size must be positive\n");
+        throw -1;
+    }
+}
+
+std::vector<SweepResult> SweepEngine::run(const std::vector<SweepConfig> &grid, bool keepStreams) {
+    // Antes de arrancar el grupo: un error dentro de un hilo del grupo terminaría el proceso
+    for (const SweepConfig &cfg : grid) {
+        if (cfg.maxAE < 1 || cfg.fmTrainNum < 1 || cfg.adTrainNum < 0 || !(cfg.ensembleVhRate > 0) ||
+            cfg.ensembleVhRate > 1 || !(cfg.outputVhRate > 0) || cfg.outputVhRate > 1 ||
+            !(cfg.ensembleLearningRate > 0) || !std::isfinite(cfg.ensembleLearningRate) ||
+            !(cfg.outputLearningRate > 0) || !std::isfinite(cfg.outputLearningRate)) {
+            fprintf(stderr, "KitNET: invalid sweep configuration (maxAE %d, fmTrainNum %d, adTrainNum %d)\n",
+                    cfg.maxAE, cfg.fmTrainNum, cfg.adTrainNum);
+            throw -1;
+        }
+    }
+    int configs = grid.size();
+    std::vector<SweepResult> results(configs);
+    std::vector<KitNET *> models(configs);
+    for (int c = 0; c < configs; ++c) {
+        const SweepConfig &cfg = grid[c];
+        results[c].config = cfg;
+        if (keepStreams)results[c].rmse.resize(rows);
+        models[c] = new KitNET(n, cfg.maxAE, cfg.fmTrainNum, cfg.ensembleVhRate, cfg.outputVhRate,
+                               cfg.ensembleLearningRate, cfg.outputLearningRate);
+    }
+    std::vector<double> sum(configs, 0);
+    std::mutex initMutex;
+    for (long long begin = 0; begin < rows; begin += blockRows) {
+        long long end = std::min(rows, begin + blockRows);
+        std::atomic<int> nextConfig(0);
+        pool.run([&](int) {
+            int c;
+            while ((c = nextConfig.fetch_add(1)) < configs) {
+                KitNET *model = models[c];
+                SweepResult &result = results[c];
+                long long trainNum = (long long) grid[c].fmTrainNum + grid[c].adTrainNum;
+                long long split = std::max(begin, std::min(end, trainNum));
+                auto t0 = std::chrono::steady_clock::now();
+                for (long long r = begin; r < split; ++r) {
+                    double score;
+                    if (!model->isInitialized()) {
+                        // Cualquier fila de la fase de mapeo puede construir los autocodificadores (al final de la fase
+                        // o en un punto de control del mapeo adaptativo), cuyos pesos iniciales salen de rand_uniform
+                        // (estado global de rand): una configuración cada vez
+                        std::lock_guard<std::mutex> lock(initMutex);
+                        score = model->train(X + (size_t) r * n);
+                    } else score = model->train(X + (size_t) r * n);
+                    if (keepStreams)result.rmse[r] = score;
+                }
+                auto t1 = std::chrono::steady_clock::now();
+                for (long long r = split; r < end; ++r) {
+                    double score = model->execute(X + (size_t) r * n);
+                    sum[c] += score;
+                    result.maxRMSE = std::max(result.maxRMSE, score);
+                    ++result.executed;
+                    if (keepStreams)result.rmse[r] = score;
+                }
+                auto t2 = std::chrono::steady_clock::now();
+                result.trainSeconds += std::chrono::duration<double>(t1 - t0).count();
+                result.executeSeconds += std::chrono::duration<double>(t2 - t1).count();
+            }
+        });
+    }
+    for (int c = 0; c < configs; ++c) {
+        if (results[c].executed > 0)results[c].meanRMSE = sum[c] / results[c].executed;
+        if (results[c].executeSeconds > 0)results[c].throughput = results[c].executed / results[c].executeSeconds;
+        delete models[c];
+    }
+    return results;
+}
+
+std::vector<double> SweepEngine::loadVectors(FE &fe) {
+    int sz = fe.getVectorSize();
+    std::vector<double> X, x(sz);
+    while (fe.nextVector(x.data()))X.insert(X.end(), x.begin(), x.end());
+    return X;
+}
+
+std::vector<SweepConfig> SweepEngine::grid(const std::vector<int> &maxAE, const std::vector<int> &fmTrainNum,
+                                           const std::vector<int> &adTrainNum,
+                                           const std::vector<double> &ensembleVhRate,
+                                           const std::vector<double> &outputVhRate,
+                                           const std::vector<double> &ensembleLearningRate,
+                                           const std::vector<double> &outputLearningRate) {
+    std::vector<SweepConfig> configs;
+    SweepConfig cfg;
+    for (int a : maxAE)
+        for (int fm : fmTrainNum)
+            for (int ad : adTrainNum)
+                for (double ev : ensembleVhRate)
+                    for (double ov : outputVhRate)
+                        for (double el : ensembleLearningRate)
+                            for (double ol : outputLearningRate) {
+                                cfg.maxAE = a;
+                                cfg.fmTrainNum = fm;
+                                cfg.adTrainNum = ad;
+                                cfg.ensembleVhRate = ev;
+                                cfg.outputVhRate = ov;
+                                cfg.ensembleLearningRate = el;
+                                cfg.outputLearningRate = ol;
+                                configs.push_back(cfg);
+                            }
+    return configs;
+}
+
+void SweepEngine::printSummary(const std::vector<SweepResult> &results, FILE *fp) {
+    fprintf(fp, "maxAE,fmTrainNum,adTrainNum,ensembleVhRate,outputVhRate,ensembleLearningRate,outputLearningRate,"
+                "executed,meanRMSE,maxRMSE,trainSeconds,executeSeconds,executedPerSecond\n");
+    for (const SweepResult &r : results) {
+        const SweepConfig &c = r.config;
+        fprintf(fp, "%d,%d,%d,%g,%g,%g,%g,%lld,%.15f,%.15f,%.6f,%.6f,%.1f\n", c.maxAE, c.fmTrainNum, c.adTrainNum,
+                c.ensembleVhRate, c.outputVhRate, c.ensembleLearningRate, c.outputLearningRate, r.executed,
+                r.meanRMSE, r.maxRMSE, r.trainSeconds, r.executeSeconds, r.throughput);
+    }
+}
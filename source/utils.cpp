@@ -37,9 +37,12 @@ int TsvReader::nextLine() {
 // Convierta la columna de la columna en una cadena y regrese
 std::string TsvReader::getString(int col) {
     std::string ans;
-    ans.clear();
-    int now = id[col];
-    while (buffer[now] != delimitor && buffer[now] != '\r' && buffer[now] != '\n' && buffer[now] != '\0')
-        ans.push_back(buffer[now++]);
+    getString(col, ans);
     return ans;
 }
+
+void TsvReader::getString(int col, std::string &out) {
+    int begin = id[col], now = begin;
+    while (buffer[now] != delimitor && buffer[now] != '\r' && buffer[now] != '\n' && buffer[now] != '\0')++now;
+    out.assign(buffer + begin, now - begin);
+}
@@ -0,0 +1,79 @@
+//
+// Grupo de hilos persistente con bifurcación/unión de baja latencia.
+//
+
+#include "../include/workerPool.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+
+WorkerPool::WorkerPool(int threads, int spin) : generation(0), pending(0), sleepers(0), stop(false) {
+    spinCount = spin;
+    for (int i = 1; i < threads; ++i)workers.emplace_back(&WorkerPool::workerLoop, this, i);
+}
+
+WorkerPool::~WorkerPool() {
+    stop = true;
+    generation.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+    }
+    wake.notify_all();
+    for (auto &t : workers)t.join();
+}
+
+void WorkerPool::relax() {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    _mm_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+void WorkerPool::workerLoop(int id) {
+    unsigned seen = 0;
+    while (true) {
+        // Espera activa y, si no llega trabajo, dormir
+        int spins = 0;
+        while (generation.load() == seen) {
+            if (++spins < spinCount) {
+                relax();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            ++sleepers;
+            wake.wait(lock, [&] { return generation.load() != seen; });
+            --sleepers;
+        }
+        seen = generation.load();
+        if (stop)return;
+        (*job)(id);
+        pending.fetch_sub(1);
+    }
+}
+
+void WorkerPool::run(const std::function<void(int)> &task) {
+    if (workers.empty()) {
+        task(0);
+        return;
+    }
+    job = &task;
+    pending.store(workers.size());
+    generation.fetch_add(1);
+    // Solo se toca el mutex si algún trabajador está dormido
+    if (sleepers.load() > 0) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+        }
+        wake.notify_all();
+    }
+    task(0);
+    // Unión: espera activa y después ceder el procesador
+    int spins = 0;
+    while (pending.load() != 0) {
+        if (++spins < spinCount)relax();
+        else std::this_thread::yield();
+    }
+}
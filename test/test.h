@@ -12,4 +12,10 @@ void testDense();
 void aE();
 void kitsuneExample();
 
+// Devuelve 0 si el entrenamiento en paralelo converge como el serie
+int testParallelTrain();
+
+// Devuelve 0 si el planificador de mini lotes entrega las puntuaciones en orden y coinciden con KitNET::execute
+int testMicroBatch();
+
 #endif //KITSUNE_CPP_TEST_H
@@ -11,12 +11,6 @@ using namespace std;
 
 // Prueba Clase de red completamente conectada densa
 
-// Función de activación lineal
-inline double active1(double x) { return x; }
-
-// Derivado correspondiente
-inline double active1D(double x) { return 1; }
-
 // Función a instalar
 inline double func(double x) {
     return 7.0 * sin(0.75 * x) + 0.5 * x;
@@ -30,8 +24,8 @@ void testDense() {
     int train_num = 1000; //Número de datos de entrenamiento
 
     // Construya una red de dos capas completamente conectada y ajuste una función trigonométrica
-    auto layer1 = new Dense(1, hidden_neuron_num, sigmoid, sigmoidDerivative,0.002);
-    auto layer2 = new Dense(hidden_neuron_num, 1, active1, active1D,0.002);
+    auto layer1 = new Dense<SigmoidActivation>(1, hidden_neuron_num, 0.002);
+    auto layer2 = new Dense<IdentityActivation>(hidden_neuron_num, 1, 0.002); // Función de activación lineal
 
     auto *train_x = new double[train_num];
     auto *train_y = new double[train_num];
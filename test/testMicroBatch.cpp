@@ -0,0 +1,62 @@
+//
+// Comprobación del planificador de mini lotes: orden de entrega, puntuaciones y latencia medida desde la llegada.
+//
+
+#include "../include/microBatcher.h"
+#include "test.h"
+#include <cmath>
+
+
+using namespace std;
+
+int testMicroBatch() {
+    const int n = 40; // Tamaño del vector de características
+    const int train_num = 10000; // Muestras de entrenamiento (incluida la fase de mapeo)
+    const int fm_num = 1000; // Muestras de la fase de mapeo de características
+    const int test_num = 5000; // Vectores puntuados
+    const double age = 1000; // Antigüedad de la llegada de uno de cada diez vectores, en microsegundos
+
+    vector<double> X((size_t) (train_num + test_num) * n);
+    for (int k = 0; k < train_num + test_num; ++k)
+        for (int i = 0; i < n; ++i)
+            X[(size_t) k * n + i] = sin(k * 0.01 * (i % 5 + 1)) * (i % 3 + 1) + rand_uniform(-0.05, 0.05);
+
+    // Dos modelos idénticos: uno puntúa vector a vector (referencia) y el otro a través del planificador
+    srand(1);
+    KitNET reference(n, 10, fm_num);
+    reference.train_batch(X.data(), train_num);
+    srand(1);
+    KitNET batched(n, 10, fm_num);
+    batched.train_batch(X.data(), train_num);
+    const double *test = X.data() + (size_t) train_num * n;
+    vector<double> expected(test_num);
+    for (int k = 0; k < test_num; ++k)expected[k] = reference.execute(test + (size_t) k * n);
+
+    // Lote pequeño, plazo corto y objetivo de p99 inalcanzable, para que el tamaño de lote cambie durante la prueba
+    MicroBatchConfig config;
+    config.maxBatch = 16;
+    config.deadlineUs = 50;
+    config.p99TargetUs = 1;
+    config.window = 256;
+    MicroBatcher batcher(&batched, config);
+    long long next = 0, outOfOrder = 0, mismatches = 0, early = 0;
+    batcher.setScoreCallback([&](long long packet, double score, double latencyUs) {
+        if (packet != next++)++outOfOrder;
+        if (packet < 0 || packet >= test_num)return;
+        if (fabs(score - expected[packet]) > 1e-9 * max(1.0, fabs(expected[packet])))++mismatches;
+        if (packet % 10 == 0 && latencyUs < age)++early;
+    });
+    for (int k = 0; k < test_num; ++k) {
+        MicroBatcher::Clock::time_point arrival = MicroBatcher::Clock::now();
+        if (k % 10 == 0)arrival -= chrono::microseconds((long long) age);
+        batcher.submit(test + (size_t) k * n, k, arrival);
+        if (k % 7 == 0)batcher.poll();
+    }
+    batcher.flush();
+
+    bool ok = next == test_num && outOfOrder == 0 && mismatches == 0 && early == 0;
+    printf("micro-batching: %lld scores, %lld batches, final batch size %d, %lld out of order, %lld mismatches, "
+           "%lld latencies below the arrival age: %s\n", next, batcher.getBatches(), batcher.getBatchSize(),
+           outOfOrder, mismatches, early, ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,71 @@
+//
+// Prueba de convergencia del entrenamiento en paralelo de KitNET.
+//
+
+#include "../include/parallelTrainer.h"
+#include "../include/frozen.h"
+#include "test.h"
+#include <cmath>
+#include <chrono>
+
+
+using namespace std;
+
+// Vector de características sintético: grupos de características correlacionadas con ruido.
+// Las anomalías rompen la correlación entre los grupos
+static void syntheticVector(double *x, int n, int k, bool anomaly) {
+    double t = k * 0.01;
+    for (int i = 0; i < n; ++i) {
+        double base = sin(t * (i % 5 + 1)) * (i % 3 + 1);
+        if (anomaly && i % 4 == 0)base = -base + 2;
+        x[i] = base + rand_uniform(-0.05, 0.05);
+    }
+}
+
+// Error medio del modelo congelado en rows vectores
+static double meanScore(KitNET &model, const double *X, int rows) {
+    FrozenKitNET *frozen = model.freeze();
+    double sum = 0;
+    for (int r = 0; r < rows; ++r)sum += frozen->execute(X + (size_t) r * model.getInputSize());
+    delete frozen;
+    return sum / rows;
+}
+
+int testParallelTrain() {
+    const int n = 40; // Tamaño del vector de características
+    const int train_num = 40000; // Muestras de entrenamiento (incluida la fase de mapeo)
+    const int fm_num = 2000; // Muestras de la fase de mapeo de características
+    const int test_num = 2000; // Muestras de prueba normales y anómalas
+    const int replicas = 4;
+
+    vector<double> train((size_t) train_num * n), normal((size_t) test_num * n), anomaly((size_t) test_num * n);
+    for (int k = 0; k < train_num; ++k)syntheticVector(&train[(size_t) k * n], n, k, false);
+    for (int k = 0; k < test_num; ++k) {
+        syntheticVector(&normal[(size_t) k * n], n, train_num + k, false);
+        syntheticVector(&anomaly[(size_t) k * n], n, train_num + k, true);
+    }
+
+    // Mismo punto de partida para los dos modelos
+    srand(1);
+    KitNET serial(n, 10, fm_num);
+    auto t0 = chrono::steady_clock::now();
+    serial.train_batch(train.data(), train_num);
+    auto t1 = chrono::steady_clock::now();
+    srand(1);
+    KitNET parallel(n, 10, fm_num);
+    ParallelTrainer(replicas, 500).train(parallel, train.data(), train_num);
+    auto t2 = chrono::steady_clock::now();
+
+    double serialNormal = meanScore(serial, normal.data(), test_num);
+    double serialAnomaly = meanScore(serial, anomaly.data(), test_num);
+    double parallelNormal = meanScore(parallel, normal.data(), test_num);
+    double parallelAnomaly = meanScore(parallel, anomaly.data(), test_num);
+    printf("serial:   %.3f s, normal RMSE %.6f, anomaly RMSE %.6f\n",
+           chrono::duration<double>(t1 - t0).count(), serialNormal, serialAnomaly);
+    printf("parallel: %.3f s, normal RMSE %.6f, anomaly RMSE %.6f (%d replicas)\n",
+           chrono::duration<double>(t2 - t1).count(), parallelNormal, parallelAnomaly, replicas);
+    // Convergencia comparable: el error normal del modelo fusionado no se aleja del serie y sigue separando las anomalías
+    bool ok = parallelNormal < 1.5 * serialNormal && parallelAnomaly > 2 * parallelNormal;
+    printf("parallel training convergence: %s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}